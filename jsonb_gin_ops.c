@@ -19,15 +19,61 @@
 #include "access/skey.h"
 #include "catalog/pg_collation.h"
 #include "catalog/pg_type.h"
+#if PG_VERSION_NUM >= 130000
+#include "access/reloptions.h"
+#endif
+#include "mb/pg_wchar.h"
 #include "miscadmin.h"
+#include "nodes/pg_list.h"
+#include "tsearch/ts_type.h"
+#include "tsearch/ts_utils.h"
+#include "utils/array.h"
 #include "utils/builtins.h"
+#include "utils/formatting.h"
 #include "utils/jsonb.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
 
 #include "jsquery.h"
 
+/*
+ * Path patterns given by include_paths and exclude_paths options.  Items of
+ * pattern are object keys or "*" matching any key, array elements are not
+ * counted.  Pattern matches its path together with the whole subtree.
+ */
+typedef struct
+{
+	int			nitems;
+	char	  **keys;		/* NULL for "*" */
+	int		   *lens;
+	bool		exclude;
+} PathPattern;
+
+typedef struct
+{
+	int			npatterns;
+	bool		hasIncludes;
+	PathPattern *patterns;
+} PathFilter;
+
+/* Match state of path filter for a path of jsonb being indexed */
+typedef struct
+{
+	int16	   *matched;	/* items of each pattern matched, -1 if failed */
+	bool		indexed;	/* make entries for values at this path */
+	bool		descend;	/* paths below could be indexed */
+} PathFilterState;
+
 typedef struct PathHashStack
 {
-	uint32	hash;
+	uint64	hash;
+	PathFilterState filter;
+	int		depth;		/* number of path items */
+	bool	isArray;
+	int		count;		/* number of array elements seen */
+	int		nelems;		/* number of array elements */
+	int		npos;		/* number of positional hashes */
+	uint64	posHash[2];	/* hashes with positional innermost array item */
 	struct PathHashStack *parent;
 }	PathHashStack;
 
@@ -44,6 +90,11 @@ typedef struct
 #define	GINKeyTrue 0x80
 #define	GINKeyMinusInf 0x80
 #define	GINKeyEmptyArray 0x80
+#define	GINKeyTrigram 0x40
+#define	GINKeyLexeme 0x41
+#define	GINKeyPath 0x42
+#define	GINKeyMatchAll 0x43
+#define	GINKeyOverflow 0x44
 #define GINKeyLenString (INTALIGN(offsetof(GINKey, data)) + sizeof(uint32))
 #define GINKeyLenNumeric(len) (INTALIGN(offsetof(GINKey, data)) + len)
 #define GINKeyDataString(key) (*(uint32 *)((char *)key + INTALIGN(offsetof(GINKey, data))))
@@ -53,10 +104,71 @@ typedef struct
 #define GINKeyIsMinusInf(key) ((key)->type & GINKeyMinusInf)
 #define GINKeyIsEmptyArray(key) ((key)->type & GINKeyEmptyArray)
 
+/*
+ * Versions of jsonb_path_value_ops key format.  Version 2 keys are packed
+ * byte strings with numerics in order-preserving binary form (see
+ * encode_numeric()), so they are compared with memcmp().
+ */
+typedef enum
+{
+	GINKeyV1,
+	GINKeyV2
+} GINKeyVersion;
+
+/*
+ * Packed key is a byte string: big-endian path hash, type and value without
+ * alignment padding.  Flags of GINKey type are moved into value, so that
+ * memcmp() sorts packed keys in the same order as compare_path_value() sorts
+ * GINKeys: true and empty array have one byte value, while minus infinity and
+ * lower bounds of "is" conditions have no value at all.  Path hash and hashes
+ * of strings are 64-bit when hash64 option is set.
+ */
+#define PACKED_HASH_LEN(hash64)	((hash64) ? sizeof(uint64) : sizeof(uint32))
+#define PackedKeyData(key)		((unsigned char *) VARDATA_ANY(key))
+#define PackedKeyLen(key)		VARSIZE_ANY_EXHDR(key)
+
+#define NUMERIC_ENC_MINUS_INF	0x00
+#define NUMERIC_ENC_NEGATIVE	0x01
+#define NUMERIC_ENC_ZERO		0x02
+#define NUMERIC_ENC_POSITIVE	0x03
+#define NUMERIC_ENC_INF			0x04
+#define NUMERIC_ENC_NAN			0x05
+
+/*
+ * Paths of jsonb_value_path_ops are represented by bloom filter stored in
+ * 32-bit hash field of GINKey, so it can't be wider.
+ */
 #define BLOOM_BITS 2
+#define BLOOM_WIDTH 32
+#define BLOOM_MAX_BITS 6
+#define BLOOM_MIN_WIDTH 8
 #define JsonbNestedContainsStrategyNumber	13
 #define JsQueryMatchStrategyNumber			14
 
+/*
+ * Opclass options (PostgreSQL 13+).  Without options all fields are treated
+ * as having their default values.
+ */
+typedef struct
+{
+	int32		vl_len_;		/* varlena header (do not touch directly!) */
+	bool		trgm;			/* index trigrams of string values */
+	bool		fts;			/* index lexemes of string values */
+	int			fts_config;		/* offset of text search configuration name */
+	bool		casefold;		/* hash string values in lower case */
+	bool		hash64;			/* use 64-bit hashes (version 2 only) */
+	int			bloom_bits;		/* bits set in path bloom per path item */
+	int			bloom_width;	/* width of path bloom in bits */
+	int			include_paths;	/* offset of path patterns to index */
+	int			exclude_paths;	/* offset of path patterns not to index */
+	int			max_depth;		/* max depth of indexed values, 0 if unlimited */
+	int			max_array_length;	/* max number of indexed array elements */
+	int			array_positions;	/* number of positionally indexed elements */
+} JsonbGinOptions;
+
+#define GIN_OPTION(options, field, default) \
+	((options) ? (options)->field : (default))
+
 typedef struct
 {
 	Datum *entries;
@@ -64,25 +176,44 @@ typedef struct
 	bool	*partial_match;
 	int		*map;
 	int count, total;
+	JsonbGinOptions *options;
+	GINKeyVersion version;
+	bool	exactKeys;		/* keys identify paths without collisions */
+	PathFilter *filter;
+	bool	overflow;		/* overflow markers were added */
 } Entries;
 
 typedef struct
 {
-	ExtractedNode  *root;
+	CompiledQuery  *query;
 	ExtractedNode  *node;
 	uint32			hash;
 	bool			lossyHash;
-	GINKey		   *rightBound;
+	void		   *rightBound;	/* GINKey or packed key */
+	bool			recheck;	/* matching items have to be rechecked */
+	int				overflowOf;	/* entry overflow marker stands for or -1 */
+	bool		   *overflowCheck;		/* scratch space for consistent */
+	GinTernaryValue *overflowTriCheck;	/* ...and for triconsistent */
 } KeyExtra;
 
-static uint32 get_bloom_value(uint32 hash);
-static uint32 get_path_bloom(PathHashStack *stack);
-static GINKey *make_gin_key(JsonbValue *v, uint32 hash);
+static uint32 get_bloom_value(uint32 hash, int bits, int width);
+static uint32 get_path_bloom(PathHashStack *stack, int bits, int width);
+static uint64 hash_chars(char *s, int len, bool hash64);
+static uint64 hash_string(char *s, int len, bool casefold, bool hash64);
+static char *encode_numeric(Numeric num, int *len);
+static GINKey *make_gin_key_numeric(Numeric numeric);
+static GINKey *make_gin_key(JsonbValue *v, uint32 hash, bool casefold);
 static GINKey *make_gin_key_string(uint32 hash);
-static GINKey *make_gin_query_value_key(JsQueryItem *value, uint32 hash);
-static GINKey *make_gin_query_key(ExtractedNode *node, bool *partialMatch, uint32 hash, KeyExtra *keyExtra);
+static GINKey *make_gin_key_fragment(uint8 type, char *s, int len, uint32 hash);
+static GINKey *make_gin_query_value_key(JsQueryItem *value, uint32 hash, bool casefold);
+static GINKey *make_gin_query_key(ExtractedNode *node, bool *partialMatch, uint32 hash, KeyExtra *keyExtra, bool casefold);
 static GINKey *make_gin_query_key_minus_inf(uint32 hash);
+static bytea *make_packed_key(uint64 hash, bool hash64, uint8 type, void *value, int len);
+static bytea *make_packed_key_value(JsonbValue *v, uint64 hash, bool casefold, bool hash64);
+static bytea *make_packed_query_key(ExtractedNode *node, bool *partialMatch, uint64 hash, KeyExtra *keyExtra, bool casefold, bool hash64);
 static int32 compare_gin_key_value(GINKey *arg1, GINKey *arg2);
+static GINKey *make_gin_key_special(uint8 type, uint32 hash);
+static Datum make_path_value_overflow_entry(uint64 hash, bool hash64, GINKeyVersion version);
 static int add_entry(Entries *e, Datum key, Pointer extra, bool pmatch);
 
 PG_FUNCTION_INFO_V1(gin_compare_jsonb_value_path);
@@ -92,6 +223,9 @@ PG_FUNCTION_INFO_V1(gin_extract_jsonb_query_value_path);
 PG_FUNCTION_INFO_V1(gin_consistent_jsonb_value_path);
 PG_FUNCTION_INFO_V1(gin_triconsistent_jsonb_value_path);
 PG_FUNCTION_INFO_V1(gin_debug_query_value_path);
+#if PG_VERSION_NUM >= 130000
+PG_FUNCTION_INFO_V1(gin_options_jsonb_value_path);
+#endif
 
 Datum gin_compare_jsonb_value_path(PG_FUNCTION_ARGS);
 Datum gin_compare_partial_jsonb_value_path(PG_FUNCTION_ARGS);
@@ -100,6 +234,9 @@ Datum gin_extract_jsonb_query_value_path(PG_FUNCTION_ARGS);
 Datum gin_consistent_jsonb_value_path(PG_FUNCTION_ARGS);
 Datum gin_triconsistent_jsonb_value_path(PG_FUNCTION_ARGS);
 Datum gin_debug_query_value_path(PG_FUNCTION_ARGS);
+#if PG_VERSION_NUM >= 130000
+Datum gin_options_jsonb_value_path(PG_FUNCTION_ARGS);
+#endif
 
 PG_FUNCTION_INFO_V1(gin_compare_jsonb_path_value);
 PG_FUNCTION_INFO_V1(gin_compare_partial_jsonb_path_value);
@@ -108,6 +245,21 @@ PG_FUNCTION_INFO_V1(gin_extract_jsonb_query_path_value);
 PG_FUNCTION_INFO_V1(gin_consistent_jsonb_path_value);
 PG_FUNCTION_INFO_V1(gin_triconsistent_jsonb_path_value);
 PG_FUNCTION_INFO_V1(gin_debug_query_path_value);
+PG_FUNCTION_INFO_V1(gin_compare_jsonb_path_value_v2);
+PG_FUNCTION_INFO_V1(gin_compare_partial_jsonb_path_value_v2);
+PG_FUNCTION_INFO_V1(gin_extract_jsonb_path_value_v2);
+PG_FUNCTION_INFO_V1(gin_extract_jsonb_query_path_value_v2);
+#if PG_VERSION_NUM >= 130000
+PG_FUNCTION_INFO_V1(gin_options_jsonb_path_value);
+PG_FUNCTION_INFO_V1(gin_options_jsonb_path_value_v2);
+#endif
+PG_FUNCTION_INFO_V1(jsquery_match_any);
+PG_FUNCTION_INFO_V1(gin_extract_jsquery_path_value);
+PG_FUNCTION_INFO_V1(gin_extract_jsquery_query_path_value);
+PG_FUNCTION_INFO_V1(gin_consistent_jsquery_path_value);
+PG_FUNCTION_INFO_V1(gin_triconsistent_jsquery_path_value);
+PG_FUNCTION_INFO_V1(jsquery_signature);
+PG_FUNCTION_INFO_V1(jsquery_signature_match);
 
 Datum gin_compare_jsonb_path_value(PG_FUNCTION_ARGS);
 Datum gin_compare_partial_jsonb_path_value(PG_FUNCTION_ARGS);
@@ -116,6 +268,368 @@ Datum gin_extract_jsonb_query_path_value(PG_FUNCTION_ARGS);
 Datum gin_consistent_jsonb_path_value(PG_FUNCTION_ARGS);
 Datum gin_triconsistent_jsonb_path_value(PG_FUNCTION_ARGS);
 Datum gin_debug_query_path_value(PG_FUNCTION_ARGS);
+Datum gin_compare_jsonb_path_value_v2(PG_FUNCTION_ARGS);
+Datum gin_compare_partial_jsonb_path_value_v2(PG_FUNCTION_ARGS);
+Datum gin_extract_jsonb_path_value_v2(PG_FUNCTION_ARGS);
+Datum gin_extract_jsonb_query_path_value_v2(PG_FUNCTION_ARGS);
+#if PG_VERSION_NUM >= 130000
+Datum gin_options_jsonb_path_value(PG_FUNCTION_ARGS);
+Datum gin_options_jsonb_path_value_v2(PG_FUNCTION_ARGS);
+#endif
+Datum jsquery_match_any(PG_FUNCTION_ARGS);
+Datum gin_extract_jsquery_path_value(PG_FUNCTION_ARGS);
+Datum gin_extract_jsquery_query_path_value(PG_FUNCTION_ARGS);
+Datum gin_consistent_jsquery_path_value(PG_FUNCTION_ARGS);
+Datum gin_triconsistent_jsquery_path_value(PG_FUNCTION_ARGS);
+Datum jsquery_signature(PG_FUNCTION_ARGS);
+Datum jsquery_signature_match(PG_FUNCTION_ARGS);
+
+static JsonbGinOptions *
+get_gin_options(FunctionCallInfo fcinfo)
+{
+#if PG_VERSION_NUM >= 130000
+	if (PG_HAS_OPCLASS_OPTIONS())
+		return (JsonbGinOptions *) PG_GET_OPCLASS_OPTIONS();
+#endif
+	return NULL;
+}
+
+/*
+ * Text search configuration lexemes are indexed with.  Without options there
+ * are no lexemes, so the default is returned just for completeness.
+ */
+static Oid
+get_fts_config(JsonbGinOptions *options)
+{
+	char	   *name = NULL;
+
+#if PG_VERSION_NUM >= 130000
+	if (options)
+		name = GET_STRING_RELOPTION(options, fts_config);
+#endif
+	if (!name)
+		name = JSQ_DEFAULT_TS_CONFIG;
+
+	return DatumGetObjectId(DirectFunctionCall1(regconfigin,
+												CStringGetDatum(name)));
+}
+
+/*
+ * Parse comma-separated list of path patterns like 'a.*.b, "c.d"' and append
+ * them to the filter.
+ */
+static void
+parse_path_patterns(PathFilter *filter, const char *str, bool exclude)
+{
+	const char *p = str;
+	int			maxpatterns = filter->npatterns;
+
+	while (true)
+	{
+		PathPattern *pattern;
+		int			maxitems = 4;
+
+		if (filter->npatterns >= maxpatterns)
+		{
+			maxpatterns = maxpatterns * 2 + 4;
+			if (filter->patterns)
+				filter->patterns = (PathPattern *) repalloc(filter->patterns,
+										sizeof(PathPattern) * maxpatterns);
+			else
+				filter->patterns = (PathPattern *) palloc(
+										sizeof(PathPattern) * maxpatterns);
+		}
+		pattern = &filter->patterns[filter->npatterns++];
+		pattern->nitems = 0;
+		pattern->exclude = exclude;
+		pattern->keys = (char **) palloc(sizeof(char *) * maxitems);
+		pattern->lens = (int *) palloc(sizeof(int) * maxitems);
+		if (!exclude)
+			filter->hasIncludes = true;
+
+		while (true)
+		{
+			char	   *key;
+			int			len;
+
+			while (isspace((unsigned char) *p))
+				p++;
+
+			if (*p == '"')
+			{
+				StringInfoData buf;
+
+				initStringInfo(&buf);
+				p++;
+				while (*p && *p != '"')
+				{
+					if (*p == '\\' && p[1])
+						p++;
+					appendStringInfoChar(&buf, *p++);
+				}
+				if (*p != '"')
+					ereport(ERROR,
+							(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+							 errmsg("invalid path pattern \"%s\"", str)));
+				p++;
+				key = buf.data;
+				len = buf.len;
+			}
+			else
+			{
+				const char *start = p;
+
+				while (*p && *p != '.' && *p != ',' &&
+					   !isspace((unsigned char) *p))
+					p++;
+				len = p - start;
+				if (len == 0)
+					ereport(ERROR,
+							(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+							 errmsg("invalid path pattern \"%s\"", str)));
+				key = (len == 1 && *start == '*') ? NULL : pnstrdup(start, len);
+			}
+
+			if (pattern->nitems >= maxitems)
+			{
+				maxitems *= 2;
+				pattern->keys = (char **) repalloc(pattern->keys,
+												   sizeof(char *) * maxitems);
+				pattern->lens = (int *) repalloc(pattern->lens,
+												 sizeof(int) * maxitems);
+			}
+			pattern->keys[pattern->nitems] = key;
+			pattern->lens[pattern->nitems] = len;
+			pattern->nitems++;
+
+			while (isspace((unsigned char) *p))
+				p++;
+			if (*p != '.')
+				break;
+			p++;
+		}
+
+		if (*p == '\0')
+			break;
+		if (*p != ',')
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					 errmsg("invalid path pattern \"%s\"", str)));
+		p++;
+	}
+}
+
+/*
+ * Path filter is parsed once and kept in fn_extra of the support function.
+ */
+static PathFilter *
+get_path_filter(FunctionCallInfo fcinfo, JsonbGinOptions *options)
+{
+#if PG_VERSION_NUM >= 130000
+	char	   *include,
+			   *exclude;
+	PathFilter *filter;
+	MemoryContext oldcxt;
+
+	if (!options)
+		return NULL;
+
+	include = GET_STRING_RELOPTION(options, include_paths);
+	exclude = GET_STRING_RELOPTION(options, exclude_paths);
+	if (!include && !exclude)
+		return NULL;
+
+	if (fcinfo->flinfo->fn_extra)
+		return (PathFilter *) fcinfo->flinfo->fn_extra;
+
+	oldcxt = MemoryContextSwitchTo(fcinfo->flinfo->fn_mcxt);
+	filter = (PathFilter *) palloc0(sizeof(PathFilter));
+	if (include)
+		parse_path_patterns(filter, include, false);
+	if (exclude)
+		parse_path_patterns(filter, exclude, true);
+	MemoryContextSwitchTo(oldcxt);
+
+	fcinfo->flinfo->fn_extra = (void *) filter;
+	return filter;
+#else
+	return NULL;
+#endif
+}
+
+static void
+set_path_filter_flags(PathFilter *filter, PathFilterState *state)
+{
+	bool		included = !filter->hasIncludes,
+				excluded = false,
+				alive = false;
+	int			i;
+
+	for (i = 0; i < filter->npatterns; i++)
+	{
+		PathPattern *pattern = &filter->patterns[i];
+
+		if (state->matched[i] == pattern->nitems)
+		{
+			if (pattern->exclude)
+				excluded = true;
+			else
+				included = true;
+		}
+		else if (state->matched[i] >= 0 && !pattern->exclude)
+		{
+			alive = true;
+		}
+	}
+
+	state->indexed = included && !excluded;
+	state->descend = !excluded && (included || alive);
+}
+
+static void
+init_path_filter_state(PathFilter *filter, PathFilterState *state)
+{
+	state->matched = NULL;
+	state->indexed = true;
+	state->descend = true;
+
+	if (filter)
+	{
+		state->matched = (int16 *) palloc0(sizeof(int16) * filter->npatterns);
+		set_path_filter_flags(filter, state);
+	}
+}
+
+/*
+ * Make state for the key of an object having parent state.
+ */
+static void
+next_path_filter_state(PathFilter *filter, PathFilterState *parent,
+					   PathFilterState *state, char *key, int len)
+{
+	int			i;
+
+	if (!filter)
+	{
+		state->indexed = true;
+		state->descend = true;
+		return;
+	}
+
+	if (!state->matched)
+		state->matched = (int16 *) palloc(sizeof(int16) * filter->npatterns);
+
+	for (i = 0; i < filter->npatterns; i++)
+	{
+		PathPattern *pattern = &filter->patterns[i];
+		int			matched = parent->matched[i];
+
+		if (matched >= 0 && matched < pattern->nitems)
+		{
+			if (!pattern->keys[matched] ||
+				(pattern->lens[matched] == len &&
+				 memcmp(pattern->keys[matched], key, len) == 0))
+				matched++;
+			else
+				matched = -1;
+		}
+		state->matched[i] = matched;
+	}
+
+	set_path_filter_flags(filter, state);
+}
+
+/*
+ * Check if pattern could match a prefix of some path matching query path
+ * items.  Array items are already removed.
+ */
+static bool
+path_pattern_overlaps(PathPattern *pattern, PathItem **items, int nitems)
+{
+	int			i;
+
+	for (i = 0; i < pattern->nitems; i++)
+	{
+		if (i >= nitems)
+			return false;
+		if (items[i]->type == iAny)
+			return true;
+		if (!pattern->keys[i] || items[i]->type == iAnyKey)
+			continue;
+		if (pattern->lens[i] != items[i]->len ||
+			memcmp(pattern->keys[i], items[i]->s, items[i]->len) != 0)
+			return false;
+	}
+	return true;
+}
+
+/*
+ * Check if pattern matches a prefix of every path matching query path items.
+ */
+static bool
+path_pattern_covers(PathPattern *pattern, PathItem **items, int nitems)
+{
+	int			i;
+
+	for (i = 0; i < pattern->nitems; i++)
+	{
+		if (i >= nitems || items[i]->type == iAny)
+			return false;
+		if (!pattern->keys[i])
+			continue;
+		if (items[i]->type == iAnyKey ||
+			pattern->lens[i] != items[i]->len ||
+			memcmp(pattern->keys[i], items[i]->s, items[i]->len) != 0)
+			return false;
+	}
+	return true;
+}
+
+/*
+ * Check if all the values query path could refer to are indexed.
+ */
+static bool
+path_filter_is_indexed(PathFilter *filter, PathItem *path)
+{
+	PathItem   *item,
+			  **items;
+	int			nitems = 0,
+				i;
+	bool		covered;
+
+	if (!filter)
+		return true;
+
+	for (item = path; item; item = item->parent)
+		nitems++;
+	items = (PathItem **) palloc(sizeof(PathItem *) * nitems);
+	i = nitems;
+	for (item = path; item; item = item->parent)
+	{
+		if (item->type != iAnyArray && item->type != iIndexArray)
+			items[--i] = item;
+	}
+	/* skip unused slots of array items */
+	items += i;
+	nitems -= i;
+
+	covered = !filter->hasIncludes;
+	for (i = 0; i < filter->npatterns; i++)
+	{
+		PathPattern *pattern = &filter->patterns[i];
+
+		if (pattern->exclude)
+		{
+			if (path_pattern_overlaps(pattern, items, nitems))
+				return false;
+		}
+		else if (!covered)
+		{
+			covered = path_pattern_covers(pattern, items, nitems);
+		}
+	}
+	return covered;
+}
 
 static int
 add_entry(Entries *e, Datum key, Pointer extra, bool pmatch)
@@ -144,14 +658,14 @@ add_entry(Entries *e, Datum key, Pointer extra, bool pmatch)
 }
 
 static uint32
-get_bloom_value(uint32 hash)
+get_bloom_value(uint32 hash, int bits, int width)
 {
-	int i, j, vals[BLOOM_BITS], val, tmp;
+	int i, j, vals[BLOOM_MAX_BITS], val, tmp;
 	uint32 res = 0;
-	for (i = 0; i < BLOOM_BITS; i++)
+	for (i = 0; i < bits; i++)
 	{
-		val = hash % (32 - i) + i;
-		hash /= (32 - i);
+		val = hash % (width - i) + i;
+		hash /= (width - i);
 		vals[i] = val;
 
 		j = i;
@@ -163,15 +677,15 @@ get_bloom_value(uint32 hash)
 			j--;
 		}
 	}
-	for (i = 0; i < BLOOM_BITS; i++)
+	for (i = 0; i < bits; i++)
 	{
-		res |= (1 << vals[i]);
+		res |= ((uint32) 1 << vals[i]);
 	}
 	return res;
 }
 
 static uint32
-get_path_bloom(PathHashStack *stack)
+get_path_bloom(PathHashStack *stack, int bits, int width)
 {
 	uint32 res = 0, val;
 
@@ -179,7 +693,7 @@ get_path_bloom(PathHashStack *stack)
 	{
 		uint32 hash = stack->hash;
 
-		val = get_bloom_value(hash);
+		val = get_bloom_value(hash, bits, width);
 
 		res |= val;
 		stack = stack->parent;
@@ -188,7 +702,7 @@ get_path_bloom(PathHashStack *stack)
 }
 
 static uint32
-get_query_path_bloom(PathItem *pathItem, bool *lossy)
+get_query_path_bloom(PathItem *pathItem, bool *lossy, int bits, int width)
 {
 	uint32 res = 0, val;
 
@@ -200,7 +714,7 @@ get_query_path_bloom(PathItem *pathItem, bool *lossy)
 		if (pathItem->type == iKey)
 		{
 			hash = hash_any((unsigned char *)pathItem->s, pathItem->len);
-			val = get_bloom_value(hash);
+			val = get_bloom_value(hash, bits, width);
 			res |= val;
 		}
 		else if (pathItem->type == iAny || pathItem->type == iAnyKey)
@@ -252,8 +766,208 @@ log_gin_key(GINKey *key)
 }
 #endif
 
+/*
+ * Hash bytes into 32 or 64 bits.  hash_any_extended() appeared in PostgreSQL
+ * 11, but 64-bit hashes are requested only by opclass option, and options
+ * appeared in 13.
+ */
+static uint64
+hash_chars(char *s, int len, bool hash64)
+{
+#if PG_VERSION_NUM >= 110000
+	if (hash64)
+		return DatumGetUInt64(hash_any_extended((unsigned char *)s, len, 0));
+#endif
+	return DatumGetUInt32(hash_any((unsigned char *)s, len));
+}
+
+/*
+ * Hash string value.  When casefold is set, string is hashed in lower case, so
+ * strings differing only in case have the same hash.
+ */
+static uint64
+hash_string(char *s, int len, bool casefold, bool hash64)
+{
+	uint64		res;
+	char	   *folded;
+
+	if (!casefold)
+		return hash_chars(s, len, hash64);
+
+	folded = str_tolower(s, len, DEFAULT_COLLATION_OID);
+	res = hash_chars(folded, strlen(folded), hash64);
+	pfree(folded);
+	return res;
+}
+
+/*
+ * Mix hash of next path item into path hash.  32-bit hash is rotated, the
+ * same way as jsonb_path_ops does.  Rotation makes items 64 levels apart
+ * cancel each other, so 64-bit hashes, which are trusted to identify paths,
+ * are mixed non-linearly the same way as hash_combine64() does.
+ */
+static uint64
+mix_path_hash(uint64 hash, uint64 item, bool hash64)
+{
+	if (hash64)
+		return hash ^ (item + UINT64CONST(0x49a0f4dd15e5a8e3) +
+					   (hash << 54) + (hash >> 7));
+
+	hash = (uint32) (((uint32) hash << 1) | ((uint32) hash >> 31));
+	return hash ^ item;
+}
+
+/*
+ * Mix next path item into path hash: key when s is given, array otherwise.
+ * 32-bit hash is the same as JsonbHashScalarValue() computes for keys.
+ */
+static uint64
+hash_path_item(uint64 hash, char *s, int len, bool hash64)
+{
+	uint64		item = s ? hash_chars(s, len, hash64) : JB_FARRAY;
+
+	return mix_path_hash(hash, item, hash64);
+}
+
+/*
+ * Mix position of array element into path hash instead of array item.
+ * Negative index counts from the end, only the last position (-1) is used.
+ */
+static uint64
+hash_path_position(uint64 hash, int32 index, bool hash64)
+{
+	return mix_path_hash(hash, hash_chars((char *) &index, sizeof(index),
+										  hash64), hash64);
+}
+
+/*
+ * Encode numeric into byte string, which memcmp() sorts in the same order as
+ * numeric_cmp() sorts numerics.  Finite non-zero number is written as sign
+ * byte, decimal exponent and significant digits packed two per byte.  All the
+ * bytes after sign are inverted for negative numbers, so that larger absolute
+ * values go first.  Their digits are terminated by zero byte to make shorter
+ * mantissa sort after longer one with the same prefix.
+ */
+static char *
+encode_numeric(Numeric num, int *len)
+{
+	char		   *str = numeric_normalize(num),
+				   *s = str;
+	unsigned char  *res,
+				   *p,
+				   *start;
+	int8		   *digits;
+	int				exponent,
+					ndigits = 0,
+					nleading = 0,
+					i;
+	bool			neg = false,
+					point = false;
+
+	res = (unsigned char *) palloc(strlen(str) / 2 + 8);
+	p = res;
+
+	if (strcmp(str, "NaN") == 0 || strcmp(str, "Infinity") == 0 ||
+		strcmp(str, "-Infinity") == 0)
+	{
+		if (str[0] == 'N')
+			*p++ = NUMERIC_ENC_NAN;
+		else
+			*p++ = (str[0] == '-') ? NUMERIC_ENC_MINUS_INF : NUMERIC_ENC_INF;
+		*len = p - res;
+		pfree(str);
+		return (char *) res;
+	}
+
+	if (*s == '-')
+	{
+		neg = true;
+		s++;
+	}
+
+	/* mantissa digits without leading and trailing zeros */
+	digits = (int8 *) palloc(strlen(s) + 1);
+	exponent = 0;
+	for (; *s; s++)
+	{
+		if (*s == '.')
+		{
+			point = true;
+			continue;
+		}
+		if (!point)
+			exponent++;
+		if (ndigits == 0 && *s == '0')
+		{
+			nleading++;
+			continue;
+		}
+		digits[ndigits++] = *s - '0';
+	}
+	while (ndigits > 0 && digits[ndigits - 1] == 0)
+		ndigits--;
+
+	if (ndigits == 0)
+	{
+		*p++ = NUMERIC_ENC_ZERO;
+		*len = p - res;
+		pfree(digits);
+		pfree(str);
+		return (char *) res;
+	}
+
+	/* value is 0.d1d2d3... * 10^exponent */
+	exponent -= nleading;
+
+	*p++ = neg ? NUMERIC_ENC_NEGATIVE : NUMERIC_ENC_POSITIVE;
+	start = p;
+
+	/* exponents of typical values fit into single byte */
+	if (exponent >= -64 && exponent < 64)
+	{
+		*p++ = (unsigned char) (exponent + 0x41);
+	}
+	else
+	{
+		uint32	e = (uint32) (exponent + 0x800000);
+
+		*p++ = (exponent < 0) ? 0x00 : 0xFF;
+		*p++ = (e >> 16) & 0xFF;
+		*p++ = (e >> 8) & 0xFF;
+		*p++ = e & 0xFF;
+	}
+
+	for (i = 0; i < ndigits; i += 2)
+		*p++ = ((digits[i] + 1) << 4) |
+			   ((i + 1 < ndigits) ? digits[i + 1] + 1 : 0);
+
+	if (neg)
+	{
+		*p++ = 0x00;
+		for (; start < p; start++)
+			*start = ~*start;
+	}
+
+	*len = p - res;
+	pfree(digits);
+	pfree(str);
+	return (char *) res;
+}
+
+static GINKey *
+make_gin_key_numeric(Numeric numeric)
+{
+	GINKey *key;
+
+	key = (GINKey *) palloc0(GINKeyLenNumeric(VARSIZE_ANY(numeric)));
+	memcpy(GINKeyDataNumeric(key), numeric, VARSIZE_ANY(numeric));
+	SET_VARSIZE(key, GINKeyLenNumeric(VARSIZE_ANY(numeric)));
+	key->type = jbvNumeric;
+	return key;
+}
+
 static GINKey *
-make_gin_key(JsonbValue *v, uint32 hash)
+make_gin_key(JsonbValue *v, uint32 hash, bool casefold)
 {
 	GINKey *key;
 
@@ -286,18 +1000,16 @@ make_gin_key(JsonbValue *v, uint32 hash)
 		}
 		case jbvNumeric:
 		{
-			key = (GINKey *) palloc0(GINKeyLenNumeric(VARSIZE_ANY(v->val.numeric)));
-			key->type = v->type;
-			memcpy(GINKeyDataNumeric(key), v->val.numeric, VARSIZE_ANY(v->val.numeric));
-			SET_VARSIZE(key, GINKeyLenNumeric(VARSIZE_ANY(v->val.numeric)));
+			key = make_gin_key_numeric(v->val.numeric);
 			break;
 		}
 		case jbvString:
 		{
 			key = (GINKey *) palloc0(GINKeyLenString);
 			key->type = v->type;
-			GINKeyDataString(key) = hash_any((unsigned char *)v->val.string.val,
-															  v->val.string.len);
+			GINKeyDataString(key) = hash_string(v->val.string.val,
+												v->val.string.len,
+												casefold, false);
 			SET_VARSIZE(key, GINKeyLenString);
 			break;
 		}
@@ -322,13 +1034,29 @@ make_gin_key_string(uint32 hash)
 	return key;
 }
 
+/*
+ * Make key for trigram or lexeme of string value.  Fragment is hashed the same
+ * way as string value, but have separate type to not be mixed with values.
+ */
+static GINKey *
+make_gin_key_fragment(uint8 type, char *s, int len, uint32 hash)
+{
+	GINKey *key;
+
+	key = (GINKey *)palloc0(GINKeyLenString);
+	key->type = type;
+	GINKeyDataString(key) = hash_any((unsigned char *)s, len);
+	SET_VARSIZE(key, GINKeyLenString);
+	key->hash = hash;
+	return key;
+}
+
 static GINKey *
-make_gin_query_value_key(JsQueryItem *value, uint32 hash)
+make_gin_query_value_key(JsQueryItem *value, uint32 hash, bool casefold)
 {
 	GINKey *key;
 	int32	len;
 	char	*s;
-	Numeric	numeric;
 
 	switch(value->type)
 	{
@@ -341,7 +1069,7 @@ make_gin_query_value_key(JsQueryItem *value, uint32 hash)
 			key = (GINKey *)palloc(GINKeyLenString);
 			key->type = jbvString;
 			s = jsqGetString(value, &len);
-			GINKeyDataString(key) = hash_any((unsigned char *)s, len);
+			GINKeyDataString(key) = hash_string(s, len, casefold, false);
 			SET_VARSIZE(key, GINKeyLenString);
 			break;
 		case jqiBool:
@@ -350,11 +1078,7 @@ make_gin_query_value_key(JsQueryItem *value, uint32 hash)
 			SET_VARSIZE(key, GINKEYLEN);
 			break;
 		case jqiNumeric:
-			numeric = jsqGetNumeric(value);
-			key = (GINKey *)palloc(GINKeyLenNumeric(VARSIZE_ANY(numeric)));
-			key->type = jbvNumeric;
-			memcpy(GINKeyDataNumeric(key), numeric, VARSIZE_ANY(numeric));
-			SET_VARSIZE(key, GINKeyLenNumeric(VARSIZE_ANY(numeric)));
+			key = make_gin_key_numeric(jsqGetNumeric(value));
 			break;
 		default:
 			elog(ERROR,"Wrong state");
@@ -365,7 +1089,8 @@ make_gin_query_value_key(JsQueryItem *value, uint32 hash)
 }
 
 static GINKey *
-make_gin_query_key(ExtractedNode *node, bool *partialMatch, uint32 hash, KeyExtra *keyExtra)
+make_gin_query_key(ExtractedNode *node, bool *partialMatch, uint32 hash, KeyExtra *keyExtra,
+				   bool casefold)
 {
 	JsonbValue	v;
 	GINKey	   *key;
@@ -373,21 +1098,27 @@ make_gin_query_key(ExtractedNode *node, bool *partialMatch, uint32 hash, KeyExtr
 	switch (node->type)
 	{
 		case eExactValue:
-			key = make_gin_query_value_key(node->exactValue, hash);
+			key = make_gin_query_value_key(node->exactValue, hash, casefold);
+			break;
+		case eFolded:
+			Assert(casefold);
+			key = make_gin_query_value_key(node->exactValue, hash, true);
 			break;
 		case eEmptyArray:
 			v.type = jbvArray;
 			v.val.array.nElems = 0;
-			key = make_gin_key(&v, hash);
+			key = make_gin_key(&v, hash, false);
 			break;
 		case eInequality:
 			*partialMatch = true;
 			if (node->bounds.leftBound)
-				key = make_gin_query_value_key(node->bounds.leftBound, hash);
+				key = make_gin_query_value_key(node->bounds.leftBound, hash,
+											   casefold);
 			else
 				key = make_gin_query_key_minus_inf(hash);
 			if (node->bounds.rightBound)
-				keyExtra->rightBound = make_gin_query_value_key(node->bounds.rightBound, hash);
+				keyExtra->rightBound = make_gin_query_value_key(node->bounds.rightBound, hash,
+																casefold);
 			else
 				keyExtra->rightBound = NULL;
 			break;
@@ -398,12 +1129,12 @@ make_gin_query_key(ExtractedNode *node, bool *partialMatch, uint32 hash, KeyExtr
 					*partialMatch = true;
 					v.type = jbvArray;
 					v.val.array.nElems = 1;
-					key = make_gin_key(&v, hash);
+					key = make_gin_key(&v, hash, false);
 					break;
 				case jbvObject:
 					*partialMatch = true;
 					v.type = jbvObject;
-					key = make_gin_key(&v, hash);
+					key = make_gin_key(&v, hash, false);
 					break;
 				case jbvString:
 					*partialMatch = true;
@@ -417,11 +1148,11 @@ make_gin_query_key(ExtractedNode *node, bool *partialMatch, uint32 hash, KeyExtr
 					*partialMatch = true;
 					v.type = jbvBool;
 					v.val.boolean = false;
-					key = make_gin_key(&v, hash);
+					key = make_gin_key(&v, hash, false);
 					break;
 				case jbvNull:
 					v.type = jbvNull;
-					key = make_gin_key(&v, hash);
+					key = make_gin_key(&v, hash, false);
 					break;
 				default:
 					elog(ERROR,"Wrong type");
@@ -430,9 +1161,17 @@ make_gin_query_key(ExtractedNode *node, bool *partialMatch, uint32 hash, KeyExtr
 			break;
 		case eAny:
 			v.type = jbvNull;
-			key = make_gin_key(&v, hash);
+			key = make_gin_key(&v, hash, false);
 			*partialMatch = true;
 			break;
+		case eTrigram:
+			key = make_gin_key_fragment(GINKeyTrigram, node->string.val,
+										node->string.len, hash);
+			break;
+		case eLexeme:
+			key = make_gin_key_fragment(GINKeyLexeme, node->string.val,
+										node->string.len, hash);
+			break;
 		default:
 			elog(ERROR, "Wrong type");
 			break;
@@ -453,31 +1192,248 @@ make_gin_query_key_minus_inf(uint32 hash)
 	return key;
 }
 
-static bool
-check_value_path_entry_handler(ExtractedNode *node, Pointer extra)
+/*
+ * Make packed key of jsonb_path_value_ops_v2 (see PACKED_HASH_LEN()).
+ */
+static bytea *
+make_packed_key(uint64 hash, bool hash64, uint8 type, void *value, int len)
 {
-	return true;
-}
+	int				hashLen = PACKED_HASH_LEN(hash64),
+					i;
+	bytea		   *key;
+	unsigned char  *p;
 
-static int
-make_value_path_entry_handler(ExtractedNode *node, Pointer extra)
-{
-	Entries	   *e = (Entries *)extra;
-	uint32		hash;
-	bool		lossy, partialMatch = false;
-	GINKey	   *key;
-	KeyExtra   *keyExtra;
-	int			result;
+	key = (bytea *) palloc(VARHDRSZ + hashLen + 1 + len);
+	SET_VARSIZE(key, VARHDRSZ + hashLen + 1 + len);
+	p = (unsigned char *) VARDATA(key);
 
-	Assert(!isLogicalNodeType(node->type));
+	for (i = hashLen - 1; i >= 0; i--)
+	{
+		p[i] = hash & 0xFF;
+		hash >>= 8;
+	}
+	p[hashLen] = type;
+	if (len > 0)
+		memcpy(p + hashLen + 1, value, len);
 
-	hash = get_query_path_bloom(node->path, &lossy);
+	return key;
+}
+
+/*
+ * Make packed key, which value is a hash of string or its fragment.  Hash is
+ * stored big-endian as well as path hash.
+ */
+static bytea *
+make_packed_key_hashed(uint64 hash, bool hash64, uint8 type, uint64 valueHash)
+{
+	unsigned char	value[sizeof(uint64)];
+	int				len = PACKED_HASH_LEN(hash64),
+					i;
+
+	for (i = len - 1; i >= 0; i--)
+	{
+		value[i] = valueHash & 0xFF;
+		valueHash >>= 8;
+	}
+	return make_packed_key(hash, hash64, type, value, len);
+}
+
+static bytea *
+make_packed_key_value(JsonbValue *v, uint64 hash, bool casefold, bool hash64)
+{
+	bytea		   *key;
+	unsigned char	flag = 1;
+	char		   *data;
+	int				len;
+
+	switch (v->type)
+	{
+		case jbvNull:
+		case jbvObject:
+			key = make_packed_key(hash, hash64, v->type, NULL, 0);
+			break;
+		case jbvBool:
+			flag = v->val.boolean ? 1 : 0;
+			key = make_packed_key(hash, hash64, jbvBool, &flag, 1);
+			break;
+		case jbvArray:
+			key = make_packed_key(hash, hash64, jbvArray, &flag,
+								  (v->val.array.nElems == 0) ? 1 : 0);
+			break;
+		case jbvNumeric:
+			data = encode_numeric(v->val.numeric, &len);
+			key = make_packed_key(hash, hash64, jbvNumeric, data, len);
+			pfree(data);
+			break;
+		case jbvString:
+			key = make_packed_key_hashed(hash, hash64, jbvString,
+										 hash_string(v->val.string.val,
+													 v->val.string.len,
+													 casefold, hash64));
+			break;
+		default:
+			elog(ERROR, "GINKey must be scalar");
+			key = NULL; /* keep compiler quiet */
+			break;
+	}
+	return key;
+}
+
+static bytea *
+make_packed_query_value_key(JsQueryItem *value, uint64 hash, bool casefold,
+							bool hash64)
+{
+	JsonbValue	v;
+	int32		len;
+
+	switch(value->type)
+	{
+		case jqiNull:
+			v.type = jbvNull;
+			break;
+		case jqiString:
+			v.type = jbvString;
+			v.val.string.val = jsqGetString(value, &len);
+			v.val.string.len = len;
+			break;
+		case jqiBool:
+			v.type = jbvBool;
+			v.val.boolean = jsqGetBool(value);
+			break;
+		case jqiNumeric:
+			v.type = jbvNumeric;
+			v.val.numeric = jsqGetNumeric(value);
+			break;
+		default:
+			elog(ERROR,"Wrong state");
+	}
+	return make_packed_key_value(&v, hash, casefold, hash64);
+}
+
+/*
+ * Packed counterpart of make_gin_query_key().  Partial match of "is" condition
+ * and of inequality without left bound starts from the key without value,
+ * which goes before all the keys of given type.
+ */
+static bytea *
+make_packed_query_key(ExtractedNode *node, bool *partialMatch, uint64 hash,
+					  KeyExtra *keyExtra, bool casefold, bool hash64)
+{
+	JsonbValue	v;
+	bytea	   *key;
+
+	switch (node->type)
+	{
+		case eExactValue:
+			key = make_packed_query_value_key(node->exactValue, hash,
+											  casefold, hash64);
+			break;
+		case eFolded:
+			Assert(casefold);
+			key = make_packed_query_value_key(node->exactValue, hash,
+											  true, hash64);
+			break;
+		case eEmptyArray:
+			v.type = jbvArray;
+			v.val.array.nElems = 0;
+			key = make_packed_key_value(&v, hash, false, hash64);
+			break;
+		case eInequality:
+			*partialMatch = true;
+			if (node->bounds.leftBound)
+				key = make_packed_query_value_key(node->bounds.leftBound, hash,
+												  casefold, hash64);
+			else
+				key = make_packed_key(hash, hash64, jbvNumeric, NULL, 0);
+			if (node->bounds.rightBound)
+				keyExtra->rightBound = make_packed_query_value_key(node->bounds.rightBound,
+																   hash, casefold,
+																   hash64);
+			else
+				keyExtra->rightBound = NULL;
+			break;
+		case eIs:
+			switch (node->isType)
+			{
+				case jbvArray:
+				case jbvObject:
+				case jbvString:
+				case jbvNumeric:
+				case jbvBool:
+					*partialMatch = true;
+					break;
+				case jbvNull:
+					break;
+				default:
+					elog(ERROR,"Wrong type");
+					return NULL;
+			}
+			key = make_packed_key(hash, hash64, node->isType, NULL, 0);
+			break;
+		case eAny:
+			key = make_packed_key(hash, hash64, jbvNull, NULL, 0);
+			*partialMatch = true;
+			break;
+		case eTrigram:
+			key = make_packed_key_hashed(hash, hash64, GINKeyTrigram,
+										 hash_chars(node->string.val,
+													node->string.len,
+													hash64));
+			break;
+		case eLexeme:
+			key = make_packed_key_hashed(hash, hash64, GINKeyLexeme,
+										 hash_chars(node->string.val,
+													node->string.len,
+													hash64));
+			break;
+		default:
+			elog(ERROR, "Wrong type");
+			key = NULL; /* keep compiler quiet */
+			break;
+	}
+	return key;
+}
+
+static bool
+check_value_path_entry_handler(ExtractedNode *node, Pointer extra)
+{
+	Entries	   *e = (Entries *)extra;
+
+	if (node->type == eTrigram || node->type == eLexeme ||
+		node->type == eFolded)
+		return false;
+	if (!path_filter_is_indexed(e->filter, node->path))
+		return false;
+	return true;
+}
+
+static int
+make_value_path_entry_handler(ExtractedNode *node, Pointer extra)
+{
+	Entries	   *e = (Entries *)extra;
+	uint32		hash;
+	bool		lossy, partialMatch = false;
+	GINKey	   *key;
+	KeyExtra   *keyExtra;
+	int			result;
+
+	Assert(!isLogicalNodeType(node->type));
+
+	if (node->type == eTrigram || node->type == eLexeme ||
+		node->type == eFolded)
+		return -1;
+	if (!path_filter_is_indexed(e->filter, node->path))
+		return -1;
+
+	hash = get_query_path_bloom(node->path, &lossy,
+								GIN_OPTION(e->options, bloom_bits, BLOOM_BITS),
+								GIN_OPTION(e->options, bloom_width, BLOOM_WIDTH));
 	keyExtra = (KeyExtra *)palloc(sizeof(KeyExtra));
 	keyExtra->hash = hash;
 	keyExtra->node = node;
 	keyExtra->lossyHash = lossy;
 
-	key = make_gin_query_key(node, &partialMatch, hash, keyExtra);
+	key = make_gin_query_key(node, &partialMatch, hash, keyExtra, false);
 
 	result = add_entry(e, PointerGetDatum(key), (Pointer)keyExtra,
 											lossy | partialMatch);
@@ -504,6 +1460,9 @@ compare_gin_key_value(GINKey *arg1, GINKey *arg2)
 				else
 					return -1;
 			case jbvObject:
+			case GINKeyPath:
+			case GINKeyMatchAll:
+			case GINKeyOverflow:
 				return 0;
 			case jbvBool:
 				if (GINKeyIsTrue(arg1) == GINKeyIsTrue(arg2))
@@ -529,6 +1488,8 @@ compare_gin_key_value(GINKey *arg1, GINKey *arg2)
 							 PointerGetDatum(GINKeyDataNumeric(arg1)),
 							 PointerGetDatum(GINKeyDataNumeric(arg2))));
 			case jbvString:
+			case GINKeyTrigram:
+			case GINKeyLexeme:
 				if (GINKeyDataString(arg1) < GINKeyDataString(arg2))
 					return -1;
 				else if (GINKeyDataString(arg1) == GINKeyDataString(arg2))
@@ -643,14 +1604,21 @@ gin_compare_partial_jsonb_value_path(PG_FUNCTION_ARGS)
 }
 
 static Datum *
-gin_extract_jsonb_value_path_internal(Jsonb *jb, int32 *nentries, uint32 **bloom)
+gin_extract_jsonb_value_path_internal(Jsonb *jb, int32 *nentries, uint32 **bloom,
+									  JsonbGinOptions *options,
+									  PathFilter *filter)
 {
+	int			bits = GIN_OPTION(options, bloom_bits, BLOOM_BITS);
+	int			width = GIN_OPTION(options, bloom_width, BLOOM_WIDTH);
 	int			total = 2 * JB_ROOT_COUNT(jb);
 	JsonbIterator *it;
 	JsonbValue	v;
 	PathHashStack *stack;
+	PathFilterState root,
+			   *state;
 	int			i = 0,
 				r;
+	bool		skipNested = false;
 	Datum	   *entries = NULL;
 	uint32		hash;
 
@@ -667,11 +1635,14 @@ gin_extract_jsonb_value_path_internal(Jsonb *jb, int32 *nentries, uint32 **bloom
 	it = JsonbIteratorInit(&jb->root);
 
 	stack = NULL;
+	init_path_filter_state(filter, &root);
 
-	while ((r = JsonbIteratorNext(&it, &v, false)) != WJB_DONE)
+	while ((r = JsonbIteratorNext(&it, &v, skipNested)) != WJB_DONE)
 	{
 		PathHashStack  *tmp;
 
+		skipNested = false;
+
 		if (i >= total)
 		{
 			total *= 2;
@@ -680,36 +1651,49 @@ gin_extract_jsonb_value_path_internal(Jsonb *jb, int32 *nentries, uint32 **bloom
 				(*bloom) = (uint32 *) repalloc(*bloom, sizeof(uint32) * total);
 		}
 
+		/* arrays don't have own stack items, their elements share the path */
+		state = stack ? &stack->filter : &root;
+
 		switch (r)
 		{
 			case WJB_BEGIN_ARRAY:
-				if (!v.val.array.rawScalar)
-					entries[i++] = PointerGetDatum(make_gin_key(&v, get_path_bloom(stack)));
+				if (!v.val.array.rawScalar && state->indexed)
+					entries[i++] = PointerGetDatum(make_gin_key(&v, get_path_bloom(stack, bits, width), false));
 				break;
 			case WJB_BEGIN_OBJECT:
-				entries[i++] = PointerGetDatum(make_gin_key(&v, get_path_bloom(stack)));
+				if (state->indexed)
+					entries[i++] = PointerGetDatum(make_gin_key(&v, get_path_bloom(stack, bits, width), false));
 				tmp = stack;
 				stack = (PathHashStack *) palloc(sizeof(PathHashStack));
 				stack->parent = tmp;
+				stack->filter.matched = NULL;
 				break;
 			case WJB_KEY:
 				if (!stack) /* should never happen */
 					elog(ERROR, "error jsonb iteration");
-				stack->hash = 0;
-				JsonbHashScalarValue(&v, &stack->hash);
+				stack->hash = hash_path_item(0, v.val.string.val,
+											 v.val.string.len, false);
+				next_path_filter_state(filter,
+									   stack->parent ? &stack->parent->filter : &root,
+									   &stack->filter, v.val.string.val,
+									   v.val.string.len);
+				/* don't descend into subtree which isn't indexed */
+				skipNested = !stack->filter.descend;
 				break;
 			case WJB_ELEM:
 			case WJB_VALUE:
+				if (!state->indexed)
+					break;
 				if (bloom)
 				{
-					(*bloom)[i] = get_path_bloom(stack);
+					(*bloom)[i] = get_path_bloom(stack, bits, width);
 					hash = 0;
 				}
 				else
 				{
-					hash = get_path_bloom(stack);
+					hash = get_path_bloom(stack, bits, width);
 				}
-				entries[i++] =  PointerGetDatum(make_gin_key(&v, hash));
+				entries[i++] =  PointerGetDatum(make_gin_key(&v, hash, false));
 				break;
 			case WJB_END_OBJECT:
 				/* Pop the stack */
@@ -736,8 +1720,11 @@ gin_extract_jsonb_value_path(PG_FUNCTION_ARGS)
 {
 	Jsonb	   *jb = PG_GETARG_JSONB_P(0);
 	int32	   *nentries = (int32 *) PG_GETARG_POINTER(1);
+	JsonbGinOptions *options = get_gin_options(fcinfo);
 
-	PG_RETURN_POINTER(gin_extract_jsonb_value_path_internal(jb, nentries, NULL));
+	PG_RETURN_POINTER(gin_extract_jsonb_value_path_internal(jb, nentries, NULL,
+											options,
+											get_path_filter(fcinfo, options)));
 }
 
 Datum
@@ -768,17 +1755,24 @@ gin_extract_jsonb_query_value_path(PG_FUNCTION_ARGS)
 	Entries		e = {0};
 	JsQuery	   *jq;
 	ExtractedNode *root;
+	CompiledQuery *query;
+	bool		recheck;
+
+	e.options = get_gin_options(fcinfo);
+	e.filter = get_path_filter(fcinfo, e.options);
 
 	switch(strategy)
 	{
 		case JsonbContainsStrategyNumber:
 			jb = PG_GETARG_JSONB_P(0);
-			entries = gin_extract_jsonb_value_path_internal(jb, nentries, NULL);
+			entries = gin_extract_jsonb_value_path_internal(jb, nentries, NULL,
+															e.options, e.filter);
 			break;
 
 		case JsonbNestedContainsStrategyNumber:
 			jb = PG_GETARG_JSONB_P(0);
-			entries = gin_extract_jsonb_value_path_internal(jb, nentries, &bloom);
+			entries = gin_extract_jsonb_value_path_internal(jb, nentries, &bloom,
+															e.options, e.filter);
 
 			n = *nentries;
 			*pmatch = (bool *) palloc(sizeof(bool) * n);
@@ -792,6 +1786,8 @@ gin_extract_jsonb_query_value_path(PG_FUNCTION_ARGS)
 
 		case JsQueryMatchStrategyNumber:
 			jq = PG_GETARG_JSQUERY(0);
+			/* paths are represented by bloom filter */
+			e.exactKeys = false;
 			root = extractJsQuery(jq, make_value_path_entry_handler,
 									check_value_path_entry_handler, (Pointer)&e);
 			if (root)
@@ -800,8 +1796,13 @@ gin_extract_jsonb_query_value_path(PG_FUNCTION_ARGS)
 				entries = e.entries;
 				*pmatch = e.partial_match;
 				*extra_data = e.extra_data;
+				recheck = !e.exactKeys || queryNeedRecheck(root);
+				query = compileExtractedTree(root, e.count);
 				for (i = 0; i < e.count; i++)
-					((KeyExtra *)e.extra_data[i])->root = root;
+				{
+					((KeyExtra *)e.extra_data[i])->query = query;
+					((KeyExtra *)e.extra_data[i])->recheck = recheck;
+				}
 			}
 			else
 			{
@@ -815,8 +1816,11 @@ gin_extract_jsonb_query_value_path(PG_FUNCTION_ARGS)
 			break;
 	}
 
-	/* ...although "contains {}" requires a full index scan */
-	if (entries == NULL)
+	/*
+	 * ...although "contains {}" requires a full index scan, as well as query
+	 * touching only paths filtered out of the index
+	 */
+	if (*nentries == 0)
 		*searchMode = GIN_SEARCH_MODE_ALL;
 
 	PG_RETURN_POINTER(entries);
@@ -853,7 +1857,10 @@ gin_consistent_jsonb_value_path(PG_FUNCTION_ARGS)
 			if (nkeys == 0)
 				res = true;
 			else
-				res = execRecursive(((KeyExtra *)extra_data[0])->root, check);
+			{
+				res = execCompiled(((KeyExtra *)extra_data[0])->query, check);
+				*recheck = ((KeyExtra *)extra_data[0])->recheck;
+			}
 			break;
 
 		default:
@@ -914,9 +1921,15 @@ gin_triconsistent_jsonb_value_path(PG_FUNCTION_ARGS)
 			if (nkeys == 0)
 				res = GIN_MAYBE;
 			else
-				res = execRecursiveTristate(((KeyExtra *)extra_data[0])->root, check);
+				res = execCompiledTristate(((KeyExtra *)extra_data[0])->query, check);
 
-			if (res == GIN_TRUE)
+			/*
+			 * Unless extracted entries are exactly equivalent to the query,
+			 * even when all the required entries are present item still has
+			 * to be rechecked.
+			 */
+			if (res == GIN_TRUE &&
+				(nkeys == 0 || ((KeyExtra *)extra_data[0])->recheck))
 				res = GIN_MAYBE;
 
 			break;
@@ -929,15 +1942,20 @@ gin_triconsistent_jsonb_value_path(PG_FUNCTION_ARGS)
 	PG_RETURN_GIN_TERNARY_VALUE(res);
 }
 
+/*
+ * Get hash of query path.  Array item given as position is hashed with its
+ * index, others are hashed as any array element.
+ */
 static bool
-get_query_path_hash(PathItem *pathItem, uint32 *hash)
+get_query_path_hash(PathItem *pathItem, PathItem *position, uint64 *hash,
+					bool hash64)
 {
 	check_stack_depth();
 
 	if (!pathItem)
 		return true;
 
-	if (!get_query_path_hash(pathItem->parent, hash))
+	if (!get_query_path_hash(pathItem->parent, position, hash, hash64))
 	{
 		return false;
 	}
@@ -950,26 +1968,119 @@ get_query_path_hash(PathItem *pathItem, uint32 *hash)
 		else
 		{
 			if (pathItem->type == iKey)
-			{
-				*hash = (*hash << 1) | (*hash >> 31);
-				*hash ^= hash_any((unsigned char *)pathItem->s, pathItem->len);
-			}
+				*hash = hash_path_item(*hash, pathItem->s, pathItem->len,
+									   hash64);
+			else if (pathItem == position)
+				*hash = hash_path_position(*hash, pathItem->arrayIndex,
+										   hash64);
 			else if (pathItem->type == iAnyArray || pathItem->type == iIndexArray)
-			{
-				*hash = (*hash << 1) | (*hash >> 31);
-				*hash ^= JB_FARRAY;
-			}
+				*hash = hash_path_item(*hash, NULL, 0, hash64);
 			return true;
 		}
 	}
 }
 
+/*
+ * Values could be missing from the index when they are deeper than max_depth
+ * or belong to array elements beyond max_array_length.  Then the index has
+ * overflow marker at the path where the document was truncated.  So add
+ * entries for markers at every path where values matching the node could be
+ * truncated.  Present marker stands for the entry of the node.
+ */
+static void
+add_overflow_entries(Entries *e, ExtractedNode *node, int entryNum)
+{
+	int			maxDepth = GIN_OPTION(e->options, max_depth, 0),
+				maxArrayLength = GIN_OPTION(e->options, max_array_length, 0),
+				nitems = 0,
+				i;
+	bool		hash64 = GIN_OPTION(e->options, hash64, false);
+	uint64		hash = 0;
+	PathItem   *item,
+			  **items;
+
+	if (maxDepth == 0 && maxArrayLength == 0)
+		return;
+
+	for (item = node->path; item; item = item->parent)
+		nitems++;
+	items = (PathItem **) palloc(sizeof(PathItem *) * nitems);
+	i = nitems;
+	for (item = node->path; item; item = item->parent)
+		items[--i] = item;
+
+	/* path has neither iAny nor iAnyKey, see get_query_path_hash() */
+	for (i = 0; i < nitems; i++)
+	{
+		bool		isArray = (items[i]->type != iKey);
+
+		if (isArray)
+			hash = hash_path_item(hash, NULL, 0, hash64);
+		else
+			hash = hash_path_item(hash, items[i]->s, items[i]->len, hash64);
+
+		if ((isArray && maxArrayLength > 0) ||
+			(i + 1 == maxDepth && nitems > maxDepth))
+		{
+			KeyExtra   *keyExtra = (KeyExtra *) palloc0(sizeof(KeyExtra));
+
+			keyExtra->node = node;
+			keyExtra->overflowOf = entryNum;
+			add_entry(e, make_path_value_overflow_entry(hash, hash64,
+														e->version),
+					  (Pointer) keyExtra, false);
+			e->overflow = true;
+		}
+	}
+	pfree(items);
+}
+
+/*
+ * Get innermost array item of node path if the index has positional entries
+ * for it.  Trigrams and lexemes aren't indexed by position.
+ */
+static PathItem *
+get_query_position(ExtractedNode *node, JsonbGinOptions *options)
+{
+	int			positions = GIN_OPTION(options, array_positions, 0);
+	PathItem   *item;
+
+	if (positions == 0 || node->type == eTrigram || node->type == eLexeme)
+		return NULL;
+
+	for (item = node->path; item; item = item->parent)
+	{
+		if (item->type == iAnyArray)
+			return NULL;
+		if (item->type == iIndexArray)
+		{
+			if (item->arrayIndex == -1 ||
+				(item->arrayIndex >= 0 && item->arrayIndex < positions))
+				return item;
+			return NULL;
+		}
+	}
+	return NULL;
+}
+
 static bool
 check_path_value_entry_handler(ExtractedNode *node, Pointer extra)
 {
-	uint32		hash;
+	Entries	   *e = (Entries *)extra;
+	uint64		hash;
+
+	if (node->type == eTrigram && !GIN_OPTION(e->options, trgm, false))
+		return false;
+	if (node->type == eLexeme && (!GIN_OPTION(e->options, fts, false) ||
+								  node->string.cfgId != get_fts_config(e->options)))
+		return false;
+	if (node->type == eFolded && !GIN_OPTION(e->options, casefold, false))
+		return false;
+
 	hash = 0;
-	if (!get_query_path_hash(node->path, &hash))
+	if (!get_query_path_hash(node->path, NULL, &hash, false))
+		return false;
+	if (!path_filter_is_indexed(e->filter, node->path))
 		return false;
 	return true;
 }
@@ -978,64 +2089,86 @@ static int
 make_path_value_entry_handler(ExtractedNode *node, Pointer extra)
 {
 	Entries	   *e = (Entries *)extra;
-	uint32		hash;
-	GINKey	   *key;
+	uint64		hash;
+	Pointer		key;
 	KeyExtra   *keyExtra;
 	int			result;
-	bool		partialMatch = false;
+	bool		partialMatch = false,
+				casefold = GIN_OPTION(e->options, casefold, false),
+				hash64 = GIN_OPTION(e->options, hash64, false);
 
 	Assert(!isLogicalNodeType(node->type));
 
+	if (node->type == eTrigram && !GIN_OPTION(e->options, trgm, false))
+		return -1;
+	if (node->type == eLexeme && (!GIN_OPTION(e->options, fts, false) ||
+								  node->string.cfgId != get_fts_config(e->options)))
+		return -1;
+	if (node->type == eFolded && !GIN_OPTION(e->options, casefold, false))
+		return -1;
+
 	hash = 0;
-	if (!get_query_path_hash(node->path, &hash))
+	if (!get_query_path_hash(node->path, get_query_position(node, e->options),
+							 &hash, hash64))
+		return -1;
+	if (!path_filter_is_indexed(e->filter, node->path))
 		return -1;
 
-	keyExtra = (KeyExtra *)palloc(sizeof(KeyExtra));
-	keyExtra->hash = hash;
+	keyExtra = (KeyExtra *)palloc0(sizeof(KeyExtra));
+	keyExtra->hash = (uint32) hash;
 	keyExtra->node = node;
-	key = make_gin_query_key(node, &partialMatch, hash, keyExtra);
+	keyExtra->overflowOf = -1;
+	if (e->version == GINKeyV2)
+		key = (Pointer) make_packed_query_key(node, &partialMatch, hash,
+											  keyExtra, casefold, hash64);
+	else
+		key = (Pointer) make_gin_query_key(node, &partialMatch, (uint32) hash,
+										   keyExtra, casefold);
 
 	result = add_entry(e, PointerGetDatum(key), (Pointer)keyExtra, partialMatch);
+	add_overflow_entries(e, node, result);
 	return result;
 }
 
+/*
+ * Compare keys of jsonb_path_value_ops: path hash goes first, then value.
+ */
+static int32
+compare_path_value(GINKey *arg1, GINKey *arg2)
+{
+	if (arg1->hash != arg2->hash)
+		return (arg1->hash > arg2->hash) ? 1 : -1;
+	return compare_gin_key_value(arg1, arg2);
+}
+
 Datum
 gin_compare_jsonb_path_value(PG_FUNCTION_ARGS)
 {
 	GINKey	   *arg1 = (GINKey *)PG_GETARG_VARLENA_P(0);
 	GINKey	   *arg2 = (GINKey *)PG_GETARG_VARLENA_P(1);
-	int32		result = 0;
+	int32		result;
 
-	if (arg1->hash != arg2->hash)
-	{
-		result = (arg1->hash > arg2->hash) ? 1 : -1;
-	}
-	else
-	{
-		result = compare_gin_key_value(arg1, arg2);
-	}
+	result = compare_path_value(arg1, arg2);
 	PG_FREE_IF_COPY(arg1, 0);
 	PG_FREE_IF_COPY(arg2, 1);
 	PG_RETURN_INT32(result);
 }
 
-Datum
-gin_compare_partial_jsonb_path_value(PG_FUNCTION_ARGS)
+/*
+ * Compare key of jsonb_path_value_ops with partial match key of jsquery.
+ */
+static int32
+compare_partial_path_value(GINKey *partial_key, GINKey *key, KeyExtra *extra)
 {
-	GINKey	   *partial_key = (GINKey *)PG_GETARG_VARLENA_P(0);
-	GINKey	   *key = (GINKey *)PG_GETARG_VARLENA_P(1);
-	StrategyNumber strategy = PG_GETARG_UINT16(2);
-	int32		result;
+	ExtractedNode  *node = extra->node;
+	int32			result;
 
 	if (key->hash != partial_key->hash)
 	{
 		result = (key->hash > partial_key->hash) ? 1 : -1;
 	}
-	else if (strategy == JsQueryMatchStrategyNumber)
+	else
 	{
-		KeyExtra *extra = (KeyExtra *)PG_GETARG_POINTER(3);
-		ExtractedNode *node = extra->node;
-
 		switch (node->type)
 		{
 			case eInequality:
@@ -1066,12 +2199,31 @@ gin_compare_partial_jsonb_path_value(PG_FUNCTION_ARGS)
 				break;
 			default:
 				elog(ERROR, "Wrong type");
+				result = 0; /* keep compiler quiet */
 				break;
 		}
 	}
+
+	return result;
+}
+
+Datum
+gin_compare_partial_jsonb_path_value(PG_FUNCTION_ARGS)
+{
+	GINKey	   *partial_key = (GINKey *)PG_GETARG_VARLENA_P(0);
+	GINKey	   *key = (GINKey *)PG_GETARG_VARLENA_P(1);
+	StrategyNumber strategy = PG_GETARG_UINT16(2);
+	int32		result;
+
+	if (strategy == JsQueryMatchStrategyNumber)
+	{
+		KeyExtra *extra = (KeyExtra *)PG_GETARG_POINTER(3);
+
+		result = compare_partial_path_value(partial_key, key, extra);
+	}
 	else
 	{
-		result = compare_gin_key_value(key, partial_key);
+		result = compare_path_value(key, partial_key);
 	}
 
 	PG_FREE_IF_COPY(partial_key, 0);
@@ -1079,37 +2231,314 @@ gin_compare_partial_jsonb_path_value(PG_FUNCTION_ARGS)
 	PG_RETURN_INT32(result);
 }
 
-static Datum *
-gin_extract_jsonb_path_value_internal(Jsonb *jb, int32 *nentries)
+/*
+ * Compare packed keys starting from given offset: 0 compares whole keys,
+ * PACKED_HASH_LEN() compares only values.
+ */
+static int32
+compare_packed_keys(bytea *arg1, bytea *arg2, int offset)
 {
-	int			total = 2 * JB_ROOT_COUNT(jb);
-	JsonbIterator *it;
-	JsonbValue	v;
-	PathHashStack tail;
-	PathHashStack *stack;
-	int			i = 0,
-				r;
-	Datum	   *entries = NULL;
+	int		len1 = PackedKeyLen(arg1) - offset,
+			len2 = PackedKeyLen(arg2) - offset,
+			cmp;
+
+	cmp = memcmp(PackedKeyData(arg1) + offset, PackedKeyData(arg2) + offset,
+				 Min(len1, len2));
+	if (cmp != 0 || len1 == len2)
+		return cmp;
+	return (len1 < len2) ? -1 : 1;
+}
 
-	if (total == 0)
-	{
-		*nentries = 0;
-		return NULL;
-	}
+Datum
+gin_compare_jsonb_path_value_v2(PG_FUNCTION_ARGS)
+{
+	bytea	   *arg1 = PG_GETARG_BYTEA_PP(0);
+	bytea	   *arg2 = PG_GETARG_BYTEA_PP(1);
+	int32		result;
 
-	entries = (Datum *) palloc(sizeof(Datum) * total);
+	result = compare_packed_keys(arg1, arg2, 0);
+	PG_FREE_IF_COPY(arg1, 0);
+	PG_FREE_IF_COPY(arg2, 1);
+	PG_RETURN_INT32(result);
+}
 
-	it = JsonbIteratorInit(&jb->root);
+/*
+ * Packed counterpart of compare_partial_path_value().
+ */
+static int32
+compare_partial_packed_path_value(bytea *partial_key, bytea *key,
+								  KeyExtra *extra, int hashLen)
+{
+	ExtractedNode  *node = extra->node;
+	uint8			type = PackedKeyData(key)[hashLen];
+	int32			result;
+
+	result = memcmp(PackedKeyData(key), PackedKeyData(partial_key), hashLen);
+	if (result != 0)
+		return result;
+
+	switch (node->type)
+	{
+		case eInequality:
+			if (!node->bounds.leftInclusive &&
+					compare_packed_keys(key, partial_key, hashLen) <= 0)
+				return -1;
+			if (extra->rightBound)
+			{
+				result = compare_packed_keys(key, extra->rightBound, hashLen);
+				if ((node->bounds.rightInclusive && result <= 0)
+															|| result < 0)
+					result = 0;
+				else
+					result = 1;
+			}
+			break;
+		case eIs:
+			if (node->isType != type)
+				result = (type > node->isType) ? 1 : -1;
+			break;
+		case eAny:
+			break;
+		default:
+			elog(ERROR, "Wrong type");
+			break;
+	}
+
+	return result;
+}
+
+Datum
+gin_compare_partial_jsonb_path_value_v2(PG_FUNCTION_ARGS)
+{
+	bytea	   *partial_key = PG_GETARG_BYTEA_PP(0);
+	bytea	   *key = PG_GETARG_BYTEA_PP(1);
+	StrategyNumber strategy = PG_GETARG_UINT16(2);
+	int32		result;
+
+	if (strategy == JsQueryMatchStrategyNumber)
+	{
+		KeyExtra *extra = (KeyExtra *)PG_GETARG_POINTER(3);
+		bool	hash64 = GIN_OPTION(get_gin_options(fcinfo), hash64, false);
+
+		result = compare_partial_packed_path_value(partial_key, key, extra,
+												   PACKED_HASH_LEN(hash64));
+	}
+	else
+	{
+		result = compare_packed_keys(key, partial_key, 0);
+	}
+
+	PG_FREE_IF_COPY(partial_key, 0);
+	PG_FREE_IF_COPY(key, 1);
+	PG_RETURN_INT32(result);
+}
+
+/*
+ * Make entry of jsonb_path_value_ops for value or for trigram or lexeme of
+ * string value (when type is given) in the key format of given version.
+ */
+static Datum
+make_path_value_entry(JsonbValue *v, uint8 type, char *s, int len,
+					  uint64 hash, bool casefold, bool hash64,
+					  GINKeyVersion version)
+{
+	if (version == GINKeyV2)
+	{
+		if (v)
+			return PointerGetDatum(make_packed_key_value(v, hash, casefold,
+														 hash64));
+		return PointerGetDatum(make_packed_key_hashed(hash, hash64, type,
+													  hash_chars(s, len,
+																 hash64)));
+	}
+
+	if (v)
+		return PointerGetDatum(make_gin_key(v, (uint32) hash, casefold));
+	return PointerGetDatum(make_gin_key_fragment(type, s, len, (uint32) hash));
+}
+
+static Datum
+make_path_value_overflow_entry(uint64 hash, bool hash64, GINKeyVersion version)
+{
+	if (version == GINKeyV2)
+		return PointerGetDatum(make_packed_key(hash, hash64, GINKeyOverflow,
+											   NULL, 0));
+	return PointerGetDatum(make_gin_key_special(GINKeyOverflow,
+												(uint32) hash));
+}
+
+/*
+ * Add entries for every trigram of string value.  Trigram is a sequence of
+ * three consecutive characters.
+ */
+static int
+add_trigram_entries(Datum **entries, int *total, int i,
+					char *s, int len, uint64 hash, bool hash64,
+					GINKeyVersion version)
+{
+	char	   *end = s + len;
+
+	while (s < end)
+	{
+		char   *p = s;
+		int		n;
+
+		for (n = 0; n < 3 && p < end; n++)
+			p += pg_mblen(p);
+		if (n < 3 || p > end)
+			break;
+
+		if (i >= *total)
+		{
+			*total *= 2;
+			*entries = (Datum *) repalloc(*entries, sizeof(Datum) * (*total));
+		}
+		(*entries)[i++] = make_path_value_entry(NULL, GINKeyTrigram, s, p - s,
+												hash, false, hash64, version);
+
+		s += pg_mblen(s);
+	}
+
+	return i;
+}
+
+/*
+ * Add entries for every lexeme of string value.  String is parsed with
+ * fts_config of the index, only @@@ with the same configuration uses them.
+ */
+static int
+add_lexeme_entries(Datum **entries, int *total, int i, Oid cfgId,
+				   char *s, int len, uint64 hash, bool hash64,
+				   GINKeyVersion version)
+{
+	TSVector	tsv;
+	WordEntry  *we;
+	int			j;
+
+	tsv = DatumGetTSVector(DirectFunctionCall2(to_tsvector_byid,
+							ObjectIdGetDatum(cfgId),
+							PointerGetDatum(cstring_to_text_with_len(s, len))));
+	we = ARRPTR(tsv);
+
+	for (j = 0; j < tsv->size; j++)
+	{
+		if (i >= *total)
+		{
+			*total *= 2;
+			*entries = (Datum *) repalloc(*entries, sizeof(Datum) * (*total));
+		}
+		(*entries)[i++] = make_path_value_entry(NULL, GINKeyLexeme,
+												STRPTR(tsv) + we[j].pos,
+												we[j].len, hash, false,
+												hash64, version);
+	}
+
+	pfree(tsv);
+
+	return i;
+}
+
+/*
+ * Count next element of array and calculate hashes of its positional paths:
+ * for the first positions and for the last one.
+ */
+static void
+next_array_position(PathHashStack *stack, int positions, bool hash64)
+{
+	int			index = stack->count++;
+
+	stack->npos = 0;
+	if (index < positions)
+		stack->posHash[stack->npos++] =
+			hash_path_position(stack->parent->hash, index, hash64);
+	if (positions > 0 && index == stack->nelems - 1)
+		stack->posHash[stack->npos++] =
+			hash_path_position(stack->parent->hash, -1, hash64);
+}
+
+/*
+ * Add entries for value at the path of stack and at its positional paths.
+ */
+static int
+add_path_value_entries(Datum *entries, int i, JsonbValue *v,
+					   PathHashStack *stack, bool casefold, bool hash64,
+					   GINKeyVersion version)
+{
+	int			j;
+
+	entries[i++] = make_path_value_entry(v, 0, NULL, 0, stack->hash,
+										 casefold, hash64, version);
+	for (j = 0; j < stack->npos; j++)
+		entries[i++] = make_path_value_entry(v, 0, NULL, 0, stack->posHash[j],
+											 casefold, hash64, version);
+	return i;
+}
+
+/*
+ * Extract entries from jsonb.  For containment query only value entries are
+ * extracted: they are enough to find documents containing the query.
+ */
+static Datum *
+gin_extract_jsonb_path_value_internal(Jsonb *jb, int32 *nentries,
+									  JsonbGinOptions *options,
+									  PathFilter *filter, bool query,
+									  GINKeyVersion version)
+{
+	int			total = 2 * JB_ROOT_COUNT(jb);
+	JsonbIterator *it;
+	JsonbValue	v;
+	PathHashStack tail;
+	PathHashStack *stack;
+	int			i = 0,
+				j,
+				r;
+	bool		skipNested = false;
+	Datum	   *entries = NULL;
+	bool		casefold = GIN_OPTION(options, casefold, false),
+				hash64 = GIN_OPTION(options, hash64, false),
+				trgm = GIN_OPTION(options, trgm, false) && !query,
+				fts = GIN_OPTION(options, fts, false) && !query;
+	int			maxDepth = GIN_OPTION(options, max_depth, 0),
+				maxArrayLength = GIN_OPTION(options, max_array_length, 0),
+				positions = query ? 0 : GIN_OPTION(options, array_positions, 0),
+				arrayLimit;
+	Oid			ftsConfig = fts ? get_fts_config(options) : InvalidOid;
+
+	if (total == 0)
+	{
+		*nentries = 0;
+		return NULL;
+	}
+
+	/*
+	 * Document given to @> may match truncated array of indexed document
+	 * having its elements beyond max_array_length, so query entries for array
+	 * elements aren't made when arrays are truncated.
+	 */
+	arrayLimit = query ? 0 : maxArrayLength;
+
+	entries = (Datum *) palloc(sizeof(Datum) * total);
+
+	it = JsonbIteratorInit(&jb->root);
 
 	tail.parent = NULL;
 	tail.hash = 0;
+	tail.depth = 0;
+	tail.isArray = false;
+	tail.npos = 0;
+	init_path_filter_state(filter, &tail.filter);
 	stack = &tail;
 
-	while ((r = JsonbIteratorNext(&it, &v, false)) != WJB_DONE)
+	while ((r = JsonbIteratorNext(&it, &v, skipNested)) != WJB_DONE)
 	{
 		PathHashStack  *tmp;
+		JsonbContainer *jbc;
+		JsonbValue	container;
 
-		if (i >= total)
+		skipNested = false;
+
+		/* reserve room for container entries and overflow marker */
+		if (i + 4 > total)
 		{
 			total *= 2;
 			entries = (Datum *) repalloc(entries, sizeof(Datum) * total);
@@ -1123,32 +2552,113 @@ gin_extract_jsonb_path_value_internal(Jsonb *jb, int32 *nentries)
 			case WJB_BEGIN_ARRAY:
 				if (v.val.array.rawScalar)
 					break;
-				entries[i++] = PointerGetDatum(make_gin_key(&v, stack->hash));
+				if (stack->isArray)
+					next_array_position(stack, positions, hash64);
+				if (stack->filter.indexed)
+					i = add_path_value_entries(entries, i, &v, stack,
+											   casefold, hash64, version);
 				tmp = stack;
 				stack = (PathHashStack *) palloc(sizeof(PathHashStack));
 				stack->parent = tmp;
-				stack->hash = stack->parent->hash;
-				stack->hash = (stack->hash << 1) | (stack->hash >> 31);
-				stack->hash ^= JB_FARRAY;
+				stack->hash = hash_path_item(stack->parent->hash, NULL, 0,
+											 hash64);
+				/* array elements aren't items of path patterns */
+				stack->filter = stack->parent->filter;
+				stack->depth = stack->parent->depth + 1;
+				stack->isArray = true;
+				stack->count = 0;
+				stack->nelems = v.val.array.nElems;
+				stack->npos = 0;
 				break;
 			case WJB_BEGIN_OBJECT:
-				entries[i++] = PointerGetDatum(make_gin_key(&v, stack->hash));
+				if (stack->isArray)
+					next_array_position(stack, positions, hash64);
+				if (stack->filter.indexed)
+					i = add_path_value_entries(entries, i, &v, stack,
+											   casefold, hash64, version);
 				tmp = stack;
 				stack = (PathHashStack *) palloc(sizeof(PathHashStack));
 				stack->parent = tmp;
 				stack->hash = stack->parent->hash;
+				stack->filter.matched = NULL;
+				stack->depth = stack->parent->depth + 1;
+				stack->isArray = false;
+				stack->npos = 0;
 				break;
 			case WJB_KEY:
 				/* Initialize hash from parent */
 				if (!stack->parent) /* should never happen */
 					elog(ERROR, "error jsonb iteration");
-				stack->hash = stack->parent->hash;
-				JsonbHashScalarValue(&v, &stack->hash);
+				stack->hash = hash_path_item(stack->parent->hash,
+											 v.val.string.val,
+											 v.val.string.len, hash64);
+				next_path_filter_state(filter, &stack->parent->filter,
+									   &stack->filter, v.val.string.val,
+									   v.val.string.len);
+				stack->npos = stack->parent->npos;
+				for (j = 0; j < stack->npos; j++)
+					stack->posHash[j] = hash_path_item(stack->parent->posHash[j],
+													   v.val.string.val,
+													   v.val.string.len,
+													   hash64);
+				/* don't descend into subtree which isn't indexed or too deep */
+				skipNested = !stack->filter.descend ||
+					(maxDepth > 0 && stack->depth >= maxDepth);
 				break;
 			case WJB_ELEM:
+				if (stack->isArray)
+					next_array_position(stack, positions, hash64);
+				if (stack->isArray && maxArrayLength > 0 &&
+					stack->count > arrayLimit)
+				{
+					/* the rest of elements is represented by overflow marker */
+					if (!query && stack->count == maxArrayLength + 1 &&
+						stack->filter.indexed)
+						entries[i++] = make_path_value_overflow_entry(stack->hash,
+																	  hash64,
+																	  version);
+					break;
+				}
+				/* fall through */
 			case WJB_VALUE:
 				/* Element/value case */
-				entries[i++] = PointerGetDatum(make_gin_key(&v, stack->hash));
+				if (!stack->filter.indexed)
+					break;
+				if (v.type == jbvBinary)
+				{
+					/* container at max_depth isn't descended into */
+					jbc = v.val.binary.data;
+					if (jbc->header & JB_FARRAY)
+					{
+						container.type = jbvArray;
+						container.val.array.nElems = jbc->header & JB_CMASK;
+						container.val.array.rawScalar = false;
+					}
+					else
+					{
+						container.type = jbvObject;
+						container.val.object.nPairs = jbc->header & JB_CMASK;
+					}
+					i = add_path_value_entries(entries, i, &container, stack,
+											   casefold, hash64, version);
+					if (!query && (jbc->header & JB_CMASK) > 0)
+						entries[i++] = make_path_value_overflow_entry(stack->hash,
+																	  hash64,
+																	  version);
+					break;
+				}
+				i = add_path_value_entries(entries, i, &v, stack,
+										   casefold, hash64, version);
+				if (v.type == jbvString && trgm)
+					i = add_trigram_entries(&entries, &total, i,
+											v.val.string.val,
+											v.val.string.len,
+											stack->hash, hash64, version);
+				if (v.type == jbvString && fts)
+					i = add_lexeme_entries(&entries, &total, i, ftsConfig,
+										   v.val.string.val,
+										   v.val.string.len,
+										   stack->hash, hash64, version);
 				break;
 			case WJB_END_ARRAY:
 				if (!stack->parent)
@@ -1163,6 +2673,11 @@ gin_extract_jsonb_path_value_internal(Jsonb *jb, int32 *nentries)
 			default:
 				elog(ERROR, "invalid JsonbIteratorNext rc: %d", r);
 		}
+
+		/* don't descend into elements which are too deep or truncated */
+		if (stack->isArray)
+			skipNested = (maxDepth > 0 && stack->depth >= maxDepth) ||
+				(maxArrayLength > 0 && stack->count >= arrayLimit);
 	}
 
 	*nentries = i;
@@ -1175,8 +2690,23 @@ gin_extract_jsonb_path_value(PG_FUNCTION_ARGS)
 {
 	Jsonb	   *jb = PG_GETARG_JSONB_P(0);
 	int32	   *nentries = (int32 *) PG_GETARG_POINTER(1);
+	JsonbGinOptions *options = get_gin_options(fcinfo);
 
-	PG_RETURN_POINTER(gin_extract_jsonb_path_value_internal(jb, nentries));
+	PG_RETURN_POINTER(gin_extract_jsonb_path_value_internal(jb, nentries,
+								options, get_path_filter(fcinfo, options),
+								false, GINKeyV1));
+}
+
+Datum
+gin_extract_jsonb_path_value_v2(PG_FUNCTION_ARGS)
+{
+	Jsonb	   *jb = PG_GETARG_JSONB_P(0);
+	int32	   *nentries = (int32 *) PG_GETARG_POINTER(1);
+	JsonbGinOptions *options = get_gin_options(fcinfo);
+
+	PG_RETURN_POINTER(gin_extract_jsonb_path_value_internal(jb, nentries,
+								options, get_path_filter(fcinfo, options),
+								false, GINKeyV2));
 }
 
 Datum
@@ -1193,8 +2723,9 @@ gin_debug_query_path_value(PG_FUNCTION_ARGS)
 	PG_RETURN_TEXT_P(cstring_to_text(s));
 }
 
-Datum
-gin_extract_jsonb_query_path_value(PG_FUNCTION_ARGS)
+static Datum
+gin_extract_jsonb_query_path_value_internal(FunctionCallInfo fcinfo,
+											GINKeyVersion version)
 {
 	Jsonb	   *jb;
 	int32	   *nentries = (int32 *) PG_GETARG_POINTER(1);
@@ -1207,26 +2738,51 @@ gin_extract_jsonb_query_path_value(PG_FUNCTION_ARGS)
 	Entries		e = {0};
 	JsQuery	   *jq;
 	ExtractedNode *root;
+	CompiledQuery *query;
+	bool		recheck;
+
+	e.options = get_gin_options(fcinfo);
+	e.filter = get_path_filter(fcinfo, e.options);
 
 	switch(strategy)
 	{
 		case JsonbContainsStrategyNumber:
 			jb = PG_GETARG_JSONB_P(0);
-			entries = gin_extract_jsonb_path_value_internal(jb, nentries);
+			entries = gin_extract_jsonb_path_value_internal(jb, nentries,
+									e.options, e.filter, true, version);
 			break;
 
 		case JsQueryMatchStrategyNumber:
 			jq = PG_GETARG_JSQUERY(0);
+			e.version = version;
+			/* 32-bit path hashes could collide, 64-bit ones hardly ever do */
+			e.exactKeys = GIN_OPTION(e.options, hash64, false);
 			root = extractJsQuery(jq, make_path_value_entry_handler,
 										check_path_value_entry_handler, (Pointer)&e);
 			if (root)
 			{
+				bool			*overflowCheck = NULL;
+				GinTernaryValue *overflowTriCheck = NULL;
+
 				*nentries = e.count;
 				entries = e.entries;
 				*pmatch = e.partial_match;
 				*extra_data = e.extra_data;
+				recheck = !e.exactKeys || queryNeedRecheck(root);
+				query = compileExtractedTree(root, e.count);
+				if (e.overflow)
+				{
+					overflowCheck = (bool *) palloc(sizeof(bool) * e.count);
+					overflowTriCheck = (GinTernaryValue *)
+						palloc(sizeof(GinTernaryValue) * e.count);
+				}
 				for (i = 0; i < e.count; i++)
-					((KeyExtra *)e.extra_data[i])->root = root;
+				{
+					((KeyExtra *)e.extra_data[i])->query = query;
+					((KeyExtra *)e.extra_data[i])->recheck = recheck;
+					((KeyExtra *)e.extra_data[i])->overflowCheck = overflowCheck;
+					((KeyExtra *)e.extra_data[i])->overflowTriCheck = overflowTriCheck;
+				}
 			}
 			else
 			{
@@ -1240,13 +2796,79 @@ gin_extract_jsonb_query_path_value(PG_FUNCTION_ARGS)
 			break;
 	}
 
-	/* ...although "contains {}" requires a full index scan */
-	if (entries == NULL)
+	/*
+	 * ...although "contains {}" requires a full index scan, as well as query
+	 * touching only paths filtered out of the index
+	 */
+	if (*nentries == 0)
 		*searchMode = GIN_SEARCH_MODE_ALL;
 
 	PG_RETURN_POINTER(entries);
 }
 
+Datum
+gin_extract_jsonb_query_path_value(PG_FUNCTION_ARGS)
+{
+	return gin_extract_jsonb_query_path_value_internal(fcinfo, GINKeyV1);
+}
+
+Datum
+gin_extract_jsonb_query_path_value_v2(PG_FUNCTION_ARGS)
+{
+	return gin_extract_jsonb_query_path_value_internal(fcinfo, GINKeyV2);
+}
+
+/*
+ * Present overflow marker means that the entry it stands for could be missing
+ * from truncated document, so the entry is considered to be present but the
+ * item has to be rechecked.
+ */
+static bool *
+apply_overflow_entries(bool *check, int32 nkeys, Pointer *extra_data,
+					   bool *recheck)
+{
+	bool	   *result = ((KeyExtra *) extra_data[0])->overflowCheck;
+	int32		i;
+
+	if (!result)
+		return check;
+
+	memcpy(result, check, sizeof(bool) * nkeys);
+	for (i = 0; i < nkeys; i++)
+	{
+		int			target = ((KeyExtra *) extra_data[i])->overflowOf;
+
+		if (target >= 0 && check[i] && !result[target])
+		{
+			result[target] = true;
+			*recheck = true;
+		}
+	}
+	return result;
+}
+
+static GinTernaryValue *
+apply_overflow_tri_entries(GinTernaryValue *check, int32 nkeys,
+						   Pointer *extra_data)
+{
+	GinTernaryValue *result = ((KeyExtra *) extra_data[0])->overflowTriCheck;
+	int32		i;
+
+	if (!result)
+		return check;
+
+	memcpy(result, check, sizeof(GinTernaryValue) * nkeys);
+	for (i = 0; i < nkeys; i++)
+	{
+		int			target = ((KeyExtra *) extra_data[i])->overflowOf;
+
+		if (target >= 0 && check[i] != GIN_FALSE &&
+			result[target] == GIN_FALSE)
+			result[target] = GIN_MAYBE;
+	}
+	return result;
+}
+
 Datum
 gin_consistent_jsonb_path_value(PG_FUNCTION_ARGS)
 {
@@ -1277,7 +2899,12 @@ gin_consistent_jsonb_path_value(PG_FUNCTION_ARGS)
 			if (nkeys == 0)
 				res = true;
 			else
-				res = execRecursive(((KeyExtra *)extra_data[0])->root, check);
+			{
+				*recheck = ((KeyExtra *)extra_data[0])->recheck;
+				check = apply_overflow_entries(check, nkeys, extra_data,
+											   recheck);
+				res = execCompiled(((KeyExtra *)extra_data[0])->query, check);
+			}
 			break;
 
 		default:
@@ -1338,9 +2965,18 @@ gin_triconsistent_jsonb_path_value(PG_FUNCTION_ARGS)
 			if (nkeys == 0)
 				res = GIN_MAYBE;
 			else
-				res = execRecursiveTristate(((KeyExtra *)extra_data[0])->root, check);
+			{
+				check = apply_overflow_tri_entries(check, nkeys, extra_data);
+				res = execCompiledTristate(((KeyExtra *)extra_data[0])->query, check);
+			}
 
-			if (res == GIN_TRUE)
+			/*
+			 * Unless extracted entries are exactly equivalent to the query,
+			 * even when all the required entries are present item still has
+			 * to be rechecked.
+			 */
+			if (res == GIN_TRUE &&
+				(nkeys == 0 || ((KeyExtra *)extra_data[0])->recheck))
 				res = GIN_MAYBE;
 
 			break;
@@ -1353,3 +2989,721 @@ gin_triconsistent_jsonb_path_value(PG_FUNCTION_ARGS)
 	PG_RETURN_GIN_TERNARY_VALUE(res);
 }
 
+/*
+ * Query prepared for jsquery_match_any().
+ */
+typedef struct
+{
+	JsQuery		   *jq;
+	int				index;		/* subscript of query in the array */
+	CompiledQuery  *query;		/* NULL if query can't be prefiltered */
+	int				nentries;
+	Datum		   *entries;
+	KeyExtra	  **extra;
+	int			   *map;		/* number of shared key, -1 for partial match */
+} MatchAnyQuery;
+
+/*
+ * Set of queries prepared for jsquery_match_any().  Queries are decomposed
+ * into jsonb_path_value_ops entries.  Exact entries of all the queries are
+ * merged into single sorted array of distinct keys, so every key is looked
+ * up in the document only once, however many queries share it.  Set lives in
+ * its own memory context, which is deleted when the set is rebuilt.
+ */
+typedef struct
+{
+	MemoryContext	mcxt;		/* context the set is allocated in */
+	ArrayType	   *array;		/* copy of array the set was built for */
+	int				nqueries;
+	MatchAnyQuery  *queries;
+	int				nkeys;
+	Datum		   *keys;
+	bool		   *present;
+	bool		   *check;
+} MatchAnySet;
+
+static int
+compare_path_value_keys(const void *a, const void *b)
+{
+	GINKey	   *arg1 = (GINKey *)DatumGetPointer(*(const Datum *)a);
+	GINKey	   *arg2 = (GINKey *)DatumGetPointer(*(const Datum *)b);
+
+	return compare_path_value(arg1, arg2);
+}
+
+static MatchAnySet *
+make_match_any_set(ArrayType *array, MemoryContext parent)
+{
+	MemoryContext	mcxt,
+					oldcxt;
+	MatchAnySet	   *set;
+	Datum		   *elems;
+	bool		   *nulls;
+	int				nelems,
+					i,
+					j,
+					k,
+					maxentries = 0;
+	int16			typlen;
+	bool			typbyval;
+	char			typalign;
+	Datum		   *keys;
+
+	mcxt = AllocSetContextCreate(parent, "jsquery_match_any set",
+								 ALLOCSET_DEFAULT_MINSIZE,
+								 ALLOCSET_DEFAULT_INITSIZE,
+								 ALLOCSET_DEFAULT_MAXSIZE);
+	oldcxt = MemoryContextSwitchTo(mcxt);
+
+	set = (MatchAnySet *)palloc0(sizeof(MatchAnySet));
+	set->mcxt = mcxt;
+	set->array = (ArrayType *)palloc(VARSIZE(array));
+	memcpy(set->array, array, VARSIZE(array));
+
+	get_typlenbyvalalign(ARR_ELEMTYPE(array), &typlen, &typbyval, &typalign);
+	deconstruct_array(array, ARR_ELEMTYPE(array), typlen, typbyval, typalign,
+					  &elems, &nulls, &nelems);
+
+	set->queries = (MatchAnyQuery *)palloc0(Max(nelems, 1) * sizeof(MatchAnyQuery));
+	for (i = 0; i < nelems; i++)
+	{
+		MatchAnyQuery  *q = &set->queries[set->nqueries];
+		Entries			e = {0};
+		ExtractedNode  *root;
+
+		if (nulls[i])
+			continue;
+
+		q->jq = (JsQuery *)PG_DETOAST_DATUM_COPY(elems[i]);
+		q->index = ARR_LBOUND(array)[0] + i;
+		root = extractJsQuery(q->jq, make_path_value_entry_handler,
+							  check_path_value_entry_handler, (Pointer)&e);
+		if (root)
+		{
+			q->query = compileExtractedTree(root, e.count);
+			q->nentries = e.count;
+			q->entries = e.entries;
+			q->extra = (KeyExtra **)e.extra_data;
+			q->map = (int *)palloc(Max(e.count, 1) * sizeof(int));
+			for (j = 0; j < e.count; j++)
+			{
+				q->map[j] = e.partial_match[j] ? -1 : 0;
+				if (!e.partial_match[j])
+					set->nkeys++;
+			}
+			maxentries = Max(maxentries, e.count);
+		}
+		set->nqueries++;
+	}
+
+	/* merge exact keys of all the queries */
+	keys = (Datum *)palloc(Max(set->nkeys, 1) * sizeof(Datum));
+	k = 0;
+	for (i = 0; i < set->nqueries; i++)
+		for (j = 0; j < set->queries[i].nentries; j++)
+			if (set->queries[i].map[j] >= 0)
+				keys[k++] = set->queries[i].entries[j];
+
+	qsort(keys, k, sizeof(Datum), compare_path_value_keys);
+	set->nkeys = 0;
+	for (i = 0; i < k; i++)
+		if (set->nkeys == 0 ||
+			compare_path_value_keys(&keys[i], &keys[set->nkeys - 1]) != 0)
+			keys[set->nkeys++] = keys[i];
+	set->keys = keys;
+
+	for (i = 0; i < set->nqueries; i++)
+	{
+		MatchAnyQuery  *q = &set->queries[i];
+
+		for (j = 0; j < q->nentries; j++)
+		{
+			Datum  *found;
+
+			if (q->map[j] < 0)
+				continue;
+			found = (Datum *)bsearch(&q->entries[j], set->keys, set->nkeys,
+									 sizeof(Datum), compare_path_value_keys);
+			Assert(found);
+			q->map[j] = found - set->keys;
+		}
+	}
+
+	set->present = (bool *)palloc(Max(set->nkeys, 1) * sizeof(bool));
+	set->check = (bool *)palloc(Max(maxentries, 1) * sizeof(bool));
+
+	MemoryContextSwitchTo(oldcxt);
+
+	return set;
+}
+
+/*
+ * Check if document contains key matching the partial match key.  It may
+ * give false positives, which are filtered out by query execution.
+ */
+static bool
+match_any_partial(Datum *entries, int nentries, GINKey *partial_key,
+				  KeyExtra *extra)
+{
+	int		lo = 0,
+			hi = nentries;
+
+	/* find first document key having the same path hash */
+	while (lo < hi)
+	{
+		int		mid = lo + (hi - lo) / 2;
+
+		if (((GINKey *)DatumGetPointer(entries[mid]))->hash < partial_key->hash)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	for (; lo < nentries; lo++)
+	{
+		GINKey *key = (GINKey *)DatumGetPointer(entries[lo]);
+
+		if (key->hash != partial_key->hash)
+			break;
+		if (compare_partial_path_value(partial_key, key, extra) == 0)
+			return true;
+	}
+
+	return false;
+}
+
+/*
+ * Match jsonb against array of jsquery and return subscripts of the matching
+ * queries.  Prepared set of queries is cached while the same array is passed.
+ */
+Datum
+jsquery_match_any(PG_FUNCTION_ARGS)
+{
+	Jsonb		   *jb = PG_GETARG_JSONB_P(0);
+	ArrayType	   *array = PG_GETARG_ARRAYTYPE_P(1);
+	MatchAnySet	   *set = (MatchAnySet *)fcinfo->flinfo->fn_extra;
+	Datum		   *entries,
+				   *result;
+	int32			nentries;
+	int				nresult = 0,
+					i,
+					j,
+					k;
+
+	if (ARR_NDIM(array) > 1)
+		ereport(ERROR,
+				(errcode(ERRCODE_ARRAY_SUBSCRIPT_ERROR),
+				 errmsg("array of jsquery must be one-dimensional")));
+
+	if (!set || VARSIZE(set->array) != VARSIZE(array) ||
+		memcmp(set->array, array, VARSIZE(array)) != 0)
+	{
+		if (set)
+		{
+			fcinfo->flinfo->fn_extra = NULL;
+			MemoryContextDelete(set->mcxt);
+		}
+		set = make_match_any_set(array, fcinfo->flinfo->fn_mcxt);
+		fcinfo->flinfo->fn_extra = (void *)set;
+	}
+
+	entries = gin_extract_jsonb_path_value_internal(jb, &nentries, NULL, NULL,
+													false, GINKeyV1);
+	qsort(entries, nentries, sizeof(Datum), compare_path_value_keys);
+
+	/* look up all the shared keys in one pass over sorted document keys */
+	for (i = 0, k = 0; k < set->nkeys; k++)
+	{
+		int		cmp = -1;
+
+		while (i < nentries &&
+			   (cmp = compare_path_value_keys(&entries[i], &set->keys[k])) < 0)
+			i++;
+		set->present[k] = (i < nentries && cmp == 0);
+	}
+
+	result = (Datum *)palloc(Max(set->nqueries, 1) * sizeof(Datum));
+	for (i = 0; i < set->nqueries; i++)
+	{
+		MatchAnyQuery  *q = &set->queries[i];
+
+		if (q->query)
+		{
+			for (j = 0; j < q->nentries; j++)
+			{
+				if (q->map[j] >= 0)
+					set->check[j] = set->present[q->map[j]];
+				else
+					set->check[j] = match_any_partial(entries, nentries,
+											(GINKey *)DatumGetPointer(q->entries[j]),
+											q->extra[j]);
+			}
+			if (!execCompiled(q->query, set->check))
+				continue;
+		}
+
+		if (executeJsQuery(q->jq, jb))
+			result[nresult++] = Int32GetDatum(q->index);
+	}
+
+	PG_FREE_IF_COPY(jb, 0);
+
+	PG_RETURN_ARRAYTYPE_P(construct_array(result, nresult, INT4OID,
+										  sizeof(int32), true, 'i'));
+}
+
+/*
+ * jsquery_path_value_ops: GIN opclass over jsquery column for reverse search,
+ * i.e. finding queries matching given document.  Every query is indexed by
+ * set of entries such that any document matching the query contains at least
+ * one of them.  Exact entries of jsonb_path_value_ops are used as is, partial
+ * match entries are replaced with entry of their path.  Queries which can't
+ * be prefiltered are indexed by special entry extracted from every document.
+ */
+
+/* Partial match entry is expected to be much less selective than exact one */
+#define JSQUERY_PATH_COST	4
+
+static GINKey *
+make_gin_key_special(uint8 type, uint32 hash)
+{
+	GINKey *key;
+
+	key = (GINKey *)palloc(GINKEYLEN);
+	key->type = type;
+	key->hash = hash;
+	SET_VARSIZE(key, GINKEYLEN);
+	return key;
+}
+
+/*
+ * Collect entries covering the query: every document matching the query
+ * contains at least one of them.  Returns estimated cost of the cover.
+ */
+static int
+get_query_cover(ExtractedNode *node, Entries *e, List **cover)
+{
+	int		i,
+			cost = 0;
+
+	check_stack_depth();
+
+	if (node->type == eAnd)
+	{
+		List   *best = NIL;
+		int		bestCost = -1;
+
+		/* any of the arguments is enough, so take the cheapest one */
+		for (i = 0; i < node->args.count; i++)
+		{
+			List   *args = NIL;
+
+			cost = get_query_cover(node->args.items[i], e, &args);
+			if (bestCost < 0 || cost < bestCost)
+			{
+				best = args;
+				bestCost = cost;
+			}
+		}
+		*cover = list_concat(*cover, best);
+		return bestCost;
+	}
+	else if (node->type == eOr)
+	{
+		for (i = 0; i < node->args.count; i++)
+			cost += get_query_cover(node->args.items[i], e, cover);
+		return cost;
+	}
+	else
+	{
+		GINKey *key = (GINKey *)DatumGetPointer(e->entries[node->entryNum]);
+
+		if (e->partial_match[node->entryNum])
+		{
+			*cover = lappend(*cover, make_gin_key_special(GINKeyPath, key->hash));
+			return JSQUERY_PATH_COST;
+		}
+		*cover = lappend(*cover, key);
+		return 1;
+	}
+}
+
+Datum
+gin_extract_jsquery_path_value(PG_FUNCTION_ARGS)
+{
+	JsQuery		   *jq = PG_GETARG_JSQUERY(0);
+	int32		   *nentries = (int32 *)PG_GETARG_POINTER(1);
+	Entries			e = {0};
+	ExtractedNode  *root;
+	List		   *cover = NIL;
+	ListCell	   *lc;
+	Datum		   *entries;
+	int				i = 0;
+
+	root = extractJsQuery(jq, make_path_value_entry_handler,
+						  check_path_value_entry_handler, (Pointer)&e);
+	if (root)
+		get_query_cover(root, &e, &cover);
+	else
+		cover = list_make1(make_gin_key_special(GINKeyMatchAll, 0));
+
+	*nentries = list_length(cover);
+	entries = (Datum *)palloc(sizeof(Datum) * list_length(cover));
+	foreach(lc, cover)
+		entries[i++] = PointerGetDatum(lfirst(lc));
+
+	PG_RETURN_POINTER(entries);
+}
+
+Datum
+gin_extract_jsquery_query_path_value(PG_FUNCTION_ARGS)
+{
+	Jsonb		   *jb = PG_GETARG_JSONB_P(0);
+	int32		   *nentries = (int32 *)PG_GETARG_POINTER(1);
+	StrategyNumber	strategy = PG_GETARG_UINT16(2);
+	Datum		   *values,
+				   *entries;
+	int32			nvalues;
+	int				i,
+					n = 0;
+
+	if (strategy != JsQueryMatchStrategyNumber)
+		elog(ERROR, "unrecognized strategy number: %d", strategy);
+
+	values = gin_extract_jsonb_path_value_internal(jb, &nvalues, NULL, NULL,
+												   false, GINKeyV1);
+
+	entries = (Datum *)palloc(sizeof(Datum) * (2 * nvalues + 1));
+	for (i = 0; i < nvalues; i++)
+	{
+		GINKey *key = (GINKey *)DatumGetPointer(values[i]);
+
+		entries[n++] = values[i];
+		entries[n++] = PointerGetDatum(make_gin_key_special(GINKeyPath, key->hash));
+	}
+	entries[n++] = PointerGetDatum(make_gin_key_special(GINKeyMatchAll, 0));
+
+	qsort(entries, n, sizeof(Datum), compare_path_value_keys);
+	*nentries = 0;
+	for (i = 0; i < n; i++)
+		if (*nentries == 0 ||
+			compare_path_value_keys(&entries[i], &entries[*nentries - 1]) != 0)
+			entries[(*nentries)++] = entries[i];
+
+	PG_RETURN_POINTER(entries);
+}
+
+Datum
+gin_consistent_jsquery_path_value(PG_FUNCTION_ARGS)
+{
+	bool	   *check = (bool *) PG_GETARG_POINTER(0);
+	StrategyNumber strategy = PG_GETARG_UINT16(1);
+	int32		nkeys = PG_GETARG_INT32(3);
+	bool	   *recheck = (bool *) PG_GETARG_POINTER(5);
+	int32		i;
+
+	if (strategy != JsQueryMatchStrategyNumber)
+		elog(ERROR, "unrecognized strategy number: %d", strategy);
+
+	/* candidate query is always rechecked against the document */
+	*recheck = true;
+	for (i = 0; i < nkeys; i++)
+		if (check[i])
+			PG_RETURN_BOOL(true);
+
+	PG_RETURN_BOOL(false);
+}
+
+Datum
+gin_triconsistent_jsquery_path_value(PG_FUNCTION_ARGS)
+{
+	GinTernaryValue *check = (GinTernaryValue *) PG_GETARG_POINTER(0);
+	StrategyNumber strategy = PG_GETARG_UINT16(1);
+	int32		nkeys = PG_GETARG_INT32(3);
+	int32		i;
+
+	if (strategy != JsQueryMatchStrategyNumber)
+		elog(ERROR, "unrecognized strategy number: %d", strategy);
+
+	for (i = 0; i < nkeys; i++)
+		if (check[i] != GIN_FALSE)
+			PG_RETURN_GIN_TERNARY_VALUE(GIN_MAYBE);
+
+	PG_RETURN_GIN_TERNARY_VALUE(GIN_FALSE);
+}
+
+/*
+ * Document signature is a bloom filter over path hashes and path-value hashes
+ * of jsonb_path_value_ops entries.  Operator sig ?@@ jsquery checks if the
+ * document having the signature may match the query: exact entries of the
+ * query are checked by their path-value bits, partial match entries by their
+ * path bits.
+ */
+#define SIGNATURE_LEN		64		/* bytes */
+#define SIGNATURE_BITS		(SIGNATURE_LEN * BITS_PER_BYTE)
+
+#define SIGNATURE_SET(sig, bit) \
+	((sig)[(bit) / BITS_PER_BYTE] |= (1 << ((bit) % BITS_PER_BYTE)))
+#define SIGNATURE_ISSET(sig, bit) \
+	(((sig)[(bit) / BITS_PER_BYTE] & (1 << ((bit) % BITS_PER_BYTE))) != 0)
+
+static uint32
+get_signature_path_bit(GINKey *key)
+{
+	return DatumGetUInt32(hash_uint32(key->hash)) % SIGNATURE_BITS;
+}
+
+static uint32
+get_signature_value_bit(GINKey *key)
+{
+	uint32		hash;
+
+	switch (GINKeyType(key))
+	{
+		case jbvNumeric:
+			hash = DatumGetUInt32(DirectFunctionCall1(hash_numeric,
+								PointerGetDatum(GINKeyDataNumeric(key))));
+			break;
+		case jbvString:
+			hash = GINKeyDataString(key);
+			break;
+		default:
+			hash = 0;
+			break;
+	}
+
+	hash ^= key->type;
+	hash = (hash << 1) | (hash >> 31);
+	hash ^= key->hash;
+
+	return DatumGetUInt32(hash_uint32(hash)) % SIGNATURE_BITS;
+}
+
+/*
+ * Query prepared for ?@@ operator.  It lives in its own memory context, which
+ * is deleted when another query is passed.
+ */
+typedef struct
+{
+	MemoryContext	mcxt;		/* context the query is allocated in */
+	JsQuery		   *jq;			/* copy of query the bits were built for */
+	CompiledQuery  *query;		/* NULL if query can't be prefiltered */
+	int				nentries;
+	uint32		   *bits;		/* signature bit of every entry */
+	bool		   *check;
+} SignatureQuery;
+
+static SignatureQuery *
+get_signature_query(FunctionCallInfo fcinfo, JsQuery *jq)
+{
+	SignatureQuery *q = (SignatureQuery *)fcinfo->flinfo->fn_extra;
+	MemoryContext	mcxt,
+					oldcxt;
+	Entries			e = {0};
+	ExtractedNode  *root;
+	int				i;
+
+	if (q && VARSIZE(q->jq) == VARSIZE(jq) &&
+		memcmp(q->jq, jq, VARSIZE(jq)) == 0)
+		return q;
+
+	if (q)
+	{
+		fcinfo->flinfo->fn_extra = NULL;
+		MemoryContextDelete(q->mcxt);
+	}
+
+	mcxt = AllocSetContextCreate(fcinfo->flinfo->fn_mcxt,
+								 "jsquery signature query",
+								 ALLOCSET_DEFAULT_MINSIZE,
+								 ALLOCSET_DEFAULT_INITSIZE,
+								 ALLOCSET_DEFAULT_MAXSIZE);
+	oldcxt = MemoryContextSwitchTo(mcxt);
+
+	q = (SignatureQuery *)palloc0(sizeof(SignatureQuery));
+	q->mcxt = mcxt;
+	q->jq = (JsQuery *)palloc(VARSIZE(jq));
+	memcpy(q->jq, jq, VARSIZE(jq));
+	root = extractJsQuery(q->jq, make_path_value_entry_handler,
+						  check_path_value_entry_handler, (Pointer)&e);
+	if (root)
+	{
+		q->query = compileExtractedTree(root, e.count);
+		q->nentries = e.count;
+		q->bits = (uint32 *)palloc(Max(e.count, 1) * sizeof(uint32));
+		q->check = (bool *)palloc(Max(e.count, 1) * sizeof(bool));
+		for (i = 0; i < e.count; i++)
+		{
+			GINKey *key = (GINKey *)DatumGetPointer(e.entries[i]);
+
+			q->bits[i] = e.partial_match[i] ? get_signature_path_bit(key) :
+											  get_signature_value_bit(key);
+		}
+	}
+
+	MemoryContextSwitchTo(oldcxt);
+
+	fcinfo->flinfo->fn_extra = (void *)q;
+
+	return q;
+}
+
+Datum
+jsquery_signature(PG_FUNCTION_ARGS)
+{
+	Jsonb	   *jb = PG_GETARG_JSONB_P(0);
+	bytea	   *res;
+	uint8	   *sig;
+	Datum	   *entries;
+	int32		nentries;
+	int			i;
+
+	res = (bytea *)palloc0(VARHDRSZ + SIGNATURE_LEN);
+	SET_VARSIZE(res, VARHDRSZ + SIGNATURE_LEN);
+	sig = (uint8 *)VARDATA(res);
+
+	entries = gin_extract_jsonb_path_value_internal(jb, &nentries, NULL, NULL,
+													false, GINKeyV1);
+	for (i = 0; i < nentries; i++)
+	{
+		GINKey *key = (GINKey *)DatumGetPointer(entries[i]);
+
+		SIGNATURE_SET(sig, get_signature_path_bit(key));
+		SIGNATURE_SET(sig, get_signature_value_bit(key));
+	}
+
+	PG_FREE_IF_COPY(jb, 0);
+
+	PG_RETURN_BYTEA_P(res);
+}
+
+Datum
+jsquery_signature_match(PG_FUNCTION_ARGS)
+{
+	bytea		   *res = PG_GETARG_BYTEA_PP(0);
+	SignatureQuery *q = get_signature_query(fcinfo, PG_GETARG_JSQUERY(1));
+	uint8		   *sig;
+	int				i;
+
+	if (VARSIZE_ANY_EXHDR(res) != SIGNATURE_LEN)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("invalid jsquery signature length")));
+
+	if (q->query == NULL)
+		PG_RETURN_BOOL(true);
+
+	sig = (uint8 *)VARDATA_ANY(res);
+	for (i = 0; i < q->nentries; i++)
+		q->check[i] = SIGNATURE_ISSET(sig, q->bits[i]);
+
+	PG_RETURN_BOOL(execCompiled(q->query, q->check));
+}
+
+#if PG_VERSION_NUM >= 130000
+static void
+validate_path_patterns(const char *value)
+{
+	PathFilter	filter = {0};
+
+	if (value)
+		parse_path_patterns(&filter, value, false);
+}
+
+static void
+add_path_filter_reloptions(local_relopts *relopts)
+{
+	add_local_string_reloption(relopts, "include_paths",
+							   "patterns of paths to index",
+							   NULL, validate_path_patterns, NULL,
+							   offsetof(JsonbGinOptions, include_paths));
+	add_local_string_reloption(relopts, "exclude_paths",
+							   "patterns of paths not to index",
+							   NULL, validate_path_patterns, NULL,
+							   offsetof(JsonbGinOptions, exclude_paths));
+}
+
+Datum
+gin_options_jsonb_value_path(PG_FUNCTION_ARGS)
+{
+	local_relopts *relopts = (local_relopts *) PG_GETARG_POINTER(0);
+
+	init_local_reloptions(relopts, sizeof(JsonbGinOptions));
+	add_local_int_reloption(relopts, "bloom_bits",
+							"number of bits set in path bloom filter per key",
+							BLOOM_BITS, 1, BLOOM_MAX_BITS,
+							offsetof(JsonbGinOptions, bloom_bits));
+	add_local_int_reloption(relopts, "bloom_width",
+							"width of path bloom filter in bits",
+							BLOOM_WIDTH, BLOOM_MIN_WIDTH, BLOOM_WIDTH,
+							offsetof(JsonbGinOptions, bloom_width));
+	add_path_filter_reloptions(relopts);
+
+	PG_RETURN_VOID();
+}
+
+static void
+validate_fts_config(const char *value)
+{
+	if (value)
+		(void) DirectFunctionCall1(regconfigin, CStringGetDatum(value));
+}
+
+static void
+init_path_value_reloptions(local_relopts *relopts)
+{
+	init_local_reloptions(relopts, sizeof(JsonbGinOptions));
+	add_local_bool_reloption(relopts, "trgm",
+							 "index trigrams of string values",
+							 false, offsetof(JsonbGinOptions, trgm));
+	add_local_bool_reloption(relopts, "fts",
+							 "index full text search lexemes of string values",
+							 false, offsetof(JsonbGinOptions, fts));
+	add_local_string_reloption(relopts, "fts_config",
+							   "text search configuration of indexed lexemes",
+							   JSQ_DEFAULT_TS_CONFIG, validate_fts_config, NULL,
+							   offsetof(JsonbGinOptions, fts_config));
+	add_local_bool_reloption(relopts, "casefold",
+							 "hash string values in lower case",
+							 false, offsetof(JsonbGinOptions, casefold));
+	add_path_filter_reloptions(relopts);
+	add_local_int_reloption(relopts, "max_depth",
+							"max depth of indexed values, 0 for unlimited",
+							0, 0, INT_MAX,
+							offsetof(JsonbGinOptions, max_depth));
+	add_local_int_reloption(relopts, "max_array_length",
+							"max number of indexed array elements, 0 for unlimited",
+							0, 0, INT_MAX,
+							offsetof(JsonbGinOptions, max_array_length));
+	add_local_int_reloption(relopts, "array_positions",
+							"number of first array elements indexed by position",
+							0, 0, INT_MAX,
+							offsetof(JsonbGinOptions, array_positions));
+}
+
+Datum
+gin_options_jsonb_path_value(PG_FUNCTION_ARGS)
+{
+	local_relopts *relopts = (local_relopts *) PG_GETARG_POINTER(0);
+
+	init_path_value_reloptions(relopts);
+
+	PG_RETURN_VOID();
+}
+
+/*
+ * Only packed keys have room for 64-bit hashes.
+ */
+Datum
+gin_options_jsonb_path_value_v2(PG_FUNCTION_ARGS)
+{
+	local_relopts *relopts = (local_relopts *) PG_GETARG_POINTER(0);
+
+	init_path_value_reloptions(relopts);
+	add_local_bool_reloption(relopts, "hash64",
+							 "use 64-bit hashes of paths and string values",
+							 false, offsetof(JsonbGinOptions, hash64));
+
+	PG_RETURN_VOID();
+}
+#endif
@@ -59,6 +59,69 @@ CREATE OPERATOR ~~ (
 	PROCEDURE = json_jsquery_filter
 );
 
+CREATE FUNCTION jsquery_match_any(jsonb, jsquery[])
+	RETURNS int[]
+	AS 'MODULE_PATHNAME'
+	LANGUAGE C STRICT IMMUTABLE;
+
+CREATE FUNCTION jsquery_match_paths(jsonb, jsquery)
+	RETURNS SETOF text[]
+	AS 'MODULE_PATHNAME'
+	LANGUAGE C STRICT IMMUTABLE;
+
+CREATE FUNCTION jsonb_set_where(jsonb, jsquery, jsonb)
+	RETURNS jsonb
+	AS 'MODULE_PATHNAME'
+	LANGUAGE C STRICT IMMUTABLE;
+
+CREATE FUNCTION jsonb_delete_where(jsonb, jsquery)
+	RETURNS jsonb
+	AS 'MODULE_PATHNAME'
+	LANGUAGE C STRICT IMMUTABLE;
+
+CREATE FUNCTION jsonb_project(jsonb, jsquery)
+	RETURNS jsonb
+	AS 'MODULE_PATHNAME'
+	LANGUAGE C STRICT IMMUTABLE;
+
+CREATE FUNCTION jsquery_get_text(jsonb, jsquery)
+	RETURNS text
+	AS 'MODULE_PATHNAME'
+	LANGUAGE C STRICT IMMUTABLE;
+
+CREATE FUNCTION jsquery_get_numeric(jsonb, jsquery)
+	RETURNS numeric
+	AS 'MODULE_PATHNAME'
+	LANGUAGE C STRICT IMMUTABLE;
+
+CREATE FUNCTION jsquery_get_int8(jsonb, jsquery)
+	RETURNS int8
+	AS 'MODULE_PATHNAME'
+	LANGUAGE C STRICT IMMUTABLE;
+
+CREATE FUNCTION jsquery_get_bool(jsonb, jsquery)
+	RETURNS bool
+	AS 'MODULE_PATHNAME'
+	LANGUAGE C STRICT IMMUTABLE;
+
+CREATE FUNCTION jsquery_signature(jsonb)
+	RETURNS bytea
+	AS 'MODULE_PATHNAME'
+	LANGUAGE C STRICT IMMUTABLE;
+
+CREATE FUNCTION jsquery_signature_match(bytea, jsquery)
+	RETURNS bool
+	AS 'MODULE_PATHNAME'
+	LANGUAGE C STRICT IMMUTABLE;
+
+CREATE OPERATOR ?@@ (
+	LEFTARG = bytea,
+	RIGHTARG = jsquery,
+	PROCEDURE = jsquery_signature_match,
+	RESTRICT = contsel,
+	JOIN = contjoinsel
+);
+
 CREATE FUNCTION jsquery_join_and(jsquery, jsquery)
 	RETURNS jsquery
 	AS 'MODULE_PATHNAME'
@@ -293,6 +356,99 @@ CREATE OPERATOR CLASS jsonb_path_value_ops
 	FUNCTION 6  gin_triconsistent_jsonb_path_value(internal, smallint, anyarray, integer, internal, internal, internal),
 	STORAGE bytea;
 
+CREATE OR REPLACE FUNCTION gin_extract_jsquery_path_value(jsquery, internal, internal)
+	RETURNS internal
+	AS 'MODULE_PATHNAME'
+	LANGUAGE C STRICT IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION gin_extract_jsquery_query_path_value(jsonb, internal, smallint, internal, internal, internal, internal)
+	RETURNS internal
+	AS 'MODULE_PATHNAME'
+	LANGUAGE C STRICT IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION gin_consistent_jsquery_path_value(internal, smallint, jsonb, integer, internal, internal, internal, internal)
+	RETURNS boolean
+	AS 'MODULE_PATHNAME'
+	LANGUAGE C STRICT IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION gin_triconsistent_jsquery_path_value(internal, smallint, jsonb, integer, internal, internal, internal)
+	RETURNS boolean
+	AS 'MODULE_PATHNAME'
+	LANGUAGE C STRICT IMMUTABLE;
+
+CREATE OPERATOR CLASS jsquery_path_value_ops
+	FOR TYPE jsquery USING gin AS
+	OPERATOR 14  @@ (jsquery, jsonb),
+	FUNCTION 1  gin_compare_jsonb_path_value(bytea, bytea),
+	FUNCTION 2  gin_extract_jsquery_path_value(jsquery, internal, internal),
+	FUNCTION 3  gin_extract_jsquery_query_path_value(jsonb, internal, smallint, internal, internal, internal, internal),
+	FUNCTION 4  gin_consistent_jsquery_path_value(internal, smallint, jsonb, integer, internal, internal, internal, internal),
+	FUNCTION 6  gin_triconsistent_jsquery_path_value(internal, smallint, jsonb, integer, internal, internal, internal),
+	STORAGE bytea;
+
+CREATE OR REPLACE FUNCTION gin_compare_jsonb_path_value_v2(bytea, bytea)
+	RETURNS integer
+	AS 'MODULE_PATHNAME'
+	LANGUAGE C STRICT IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION gin_compare_partial_jsonb_path_value_v2(bytea, bytea, smallint, internal)
+	RETURNS integer
+	AS 'MODULE_PATHNAME'
+	LANGUAGE C STRICT IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION gin_extract_jsonb_path_value_v2(internal, internal, internal)
+	RETURNS internal
+	AS 'MODULE_PATHNAME'
+	LANGUAGE C STRICT IMMUTABLE;
+
+CREATE OR REPLACE FUNCTION gin_extract_jsonb_query_path_value_v2(anyarray, internal, smallint, internal, internal, internal, internal)
+	RETURNS internal
+	AS 'MODULE_PATHNAME'
+	LANGUAGE C STRICT IMMUTABLE;
+
+CREATE OPERATOR CLASS jsonb_path_value_ops_v2
+	FOR TYPE jsonb USING gin AS
+	OPERATOR 7  @>,
+	OPERATOR 14  @@ (jsonb, jsquery),
+	FUNCTION 1  gin_compare_jsonb_path_value_v2(bytea, bytea),
+	FUNCTION 2  gin_extract_jsonb_path_value_v2(internal, internal, internal),
+	FUNCTION 3  gin_extract_jsonb_query_path_value_v2(anyarray, internal, smallint, internal, internal, internal, internal),
+	FUNCTION 4  gin_consistent_jsonb_path_value(internal, smallint, anyarray, integer, internal, internal, internal, internal),
+	FUNCTION 5  gin_compare_partial_jsonb_path_value_v2(bytea, bytea, smallint, internal),
+	FUNCTION 6  gin_triconsistent_jsonb_path_value(internal, smallint, anyarray, integer, internal, internal, internal),
+	STORAGE bytea;
+
+-- opclass options are available since PostgreSQL 13
+DO $$
+BEGIN
+	IF current_setting('server_version_num')::int >= 130000 THEN
+		CREATE FUNCTION gin_options_jsonb_path_value(internal)
+			RETURNS void
+			AS 'MODULE_PATHNAME'
+			LANGUAGE C IMMUTABLE;
+
+		ALTER OPERATOR FAMILY jsonb_path_value_ops USING gin
+			ADD FUNCTION 7 (jsonb) gin_options_jsonb_path_value(internal);
+
+		CREATE FUNCTION gin_options_jsonb_path_value_v2(internal)
+			RETURNS void
+			AS 'MODULE_PATHNAME'
+			LANGUAGE C IMMUTABLE;
+
+		ALTER OPERATOR FAMILY jsonb_path_value_ops_v2 USING gin
+			ADD FUNCTION 7 (jsonb) gin_options_jsonb_path_value_v2(internal);
+
+		CREATE FUNCTION gin_options_jsonb_value_path(internal)
+			RETURNS void
+			AS 'MODULE_PATHNAME'
+			LANGUAGE C IMMUTABLE;
+
+		ALTER OPERATOR FAMILY jsonb_value_path_ops USING gin
+			ADD FUNCTION 7 (jsonb) gin_options_jsonb_value_path(internal);
+	END IF;
+END
+$$;
+
 CREATE OR REPLACE FUNCTION gin_debug_query_value_path(jsquery)
 	RETURNS text
 	AS 'MODULE_PATHNAME'
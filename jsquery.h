@@ -59,7 +59,17 @@ typedef enum JsQueryItemType {
 		jqiIn,
 		jqiIs,
 		jqiIndexArray,
-		jqiFilter
+		jqiFilter,
+		jqiRegex,
+		jqiLike,
+		jqiFts,
+		jqiIEqual,
+		jqiSliceArray,
+		jqiPath,
+		jqiAdd,
+		jqiSub,
+		jqiMul,
+		jqiDiv
 } JsQueryItemType;
 
 /*
@@ -108,10 +118,20 @@ typedef struct JsQueryItem {
 			int32	*arrayPtr;
 		} array;
 
-		uint32		arrayIndex;
+		int32		arrayIndex;	/* negative counts from the end */
+
+		struct {
+			int32	start;
+			int32	end;		/* JSQ_SLICE_END if open */
+		} slice;
 	};
 } JsQueryItem;
 
+#define JSQ_SLICE_END	PG_INT32_MAX
+
+/* text search configuration of @@@ when query doesn't name one */
+#define JSQ_DEFAULT_TS_CONFIG	"simple"
+
 extern void jsqInit(JsQueryItem *v, JsQuery *js);
 extern void jsqInitByBuffer(JsQueryItem *v, char *base, int32 pos);
 extern bool jsqGetNext(JsQueryItem *v, JsQueryItem *a);
@@ -122,6 +142,7 @@ extern Numeric	jsqGetNumeric(JsQueryItem *v);
 extern bool		jsqGetBool(JsQueryItem *v);
 extern int32	jsqGetIsType(JsQueryItem *v);
 extern char * jsqGetString(JsQueryItem *v, int32 *len);
+extern Oid	jsqGetTSConfig(JsQueryItem *v);
 extern void jsqIterateInit(JsQueryItem *v);
 extern bool jsqIterateArray(JsQueryItem *v, JsQueryItem *e);
 extern void jsqIterateDestroy(JsQueryItem *v);
@@ -161,12 +182,25 @@ struct JsQueryParseItem {
 			JsQueryParseItem	**elems;
 		} array;
 
-		uint32		arrayIndex;
+		int32		arrayIndex;
+
+		struct {
+			int32	start;
+			int32	end;
+		} slice;
 	};
 };
 
 extern JsQueryParseItem* parsejsquery(const char *str, int len);
 
+/* jsquery_io.c */
+
+extern JsQuery *compileJsQuery(const char *str, int len);
+
+/* jsquery_op.c */
+
+extern bool executeJsQuery(JsQuery *jq, Jsonb *jb);
+
 /* jsquery_extract.c */
 
 typedef enum
@@ -195,6 +229,9 @@ typedef enum
 	eInequality,
 	eIs,
 	eAny,
+	eTrigram,
+	eLexeme,
+	eFolded,
 	eAnd		= jqiAnd,
 	eOr			= jqiOr,
 } ExtractedNodeType;
@@ -215,6 +252,7 @@ struct ExtractedNode
 	JsQueryHint			hint;
 	PathItem		   *path;
 	bool				indirect;
+	bool				lossy;		/* weaker than query part it came from */
 	SelectivityClass	sClass;
 	bool				forceIndex;
 	int					number;
@@ -235,6 +273,12 @@ struct ExtractedNode
 		} bounds;
 		JsQueryItem		   *exactValue;
 		int32				isType;
+		struct
+		{
+			char		   *val;
+			int				len;
+			Oid				cfgId;	/* text search configuration of eLexeme */
+		}					string;
 	};
 };
 
@@ -247,8 +291,31 @@ ExtractedNode *extractJsQuery(JsQuery *jq, MakeEntryHandler makeHandler,
 char *debugJsQuery(JsQuery *jq, MakeEntryHandler makeHandler,
 								CheckEntryHandler checkHandler, Pointer extra);
 bool queryNeedRecheck(ExtractedNode *node);
-bool execRecursive(ExtractedNode *node, bool *check);
-bool execRecursiveTristate(ExtractedNode *node, GinTernaryValue *check);
+
+/*
+ * Extracted tree compiled into postfix program.  Queries with few entries
+ * also have truth table indexed by bitmap of present entries.
+ */
+#define JSQ_TRUTH_TABLE_MAX_ENTRIES	16
+
+typedef struct
+{
+	ExtractedNodeType	type;	/* eAnd, eOr or type of entry node */
+	int					arg;	/* number of arguments or entry number */
+} CompiledItem;
+
+typedef struct
+{
+	int					nentries;
+	int					length;
+	CompiledItem	   *items;
+	GinTernaryValue	   *stack;
+	uint64			   *truthTable;	/* NULL if there are too many entries */
+} CompiledQuery;
+
+CompiledQuery *compileExtractedTree(ExtractedNode *root, int nentries);
+bool execCompiled(CompiledQuery *query, bool *check);
+GinTernaryValue execCompiledTristate(CompiledQuery *query, GinTernaryValue *check);
 
 #ifndef PG_RETURN_JSONB_P
 #define PG_RETURN_JSONB_P(x)	PG_RETURN_JSONB(x)
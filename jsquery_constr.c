@@ -88,6 +88,11 @@ copyJsQuery(StringInfo buf, JsQueryItem *jsq)
 			break;
 		case jqiAnd:
 		case jqiOr:
+		case jqiAdd:
+		case jqiSub:
+		case jqiMul:
+		case jqiDiv:
+		case jqiFts:
 			{
 				int32	leftOut, rightOut;
 
@@ -115,6 +120,10 @@ copyJsQuery(StringInfo buf, JsQueryItem *jsq)
 		case jqiContained:
 		case jqiOverlap:
 		case jqiNot:
+		case jqiRegex:
+		case jqiLike:
+		case jqiIEqual:
+		case jqiPath:
 			{
 				int32	argOut = buf->len;
 
@@ -129,6 +138,12 @@ copyJsQuery(StringInfo buf, JsQueryItem *jsq)
 			appendBinaryStringInfo(buf, (char*)&jsq->arrayIndex,
 								   sizeof(jsq->arrayIndex));
 			break;
+		case jqiSliceArray:
+			appendBinaryStringInfo(buf, (char*)&jsq->slice.start,
+								   sizeof(jsq->slice.start));
+			appendBinaryStringInfo(buf, (char*)&jsq->slice.end,
+								   sizeof(jsq->slice.end));
+			break;
 		case jqiNull:
 		case jqiCurrent:
 		case jqiLength:
@@ -15,7 +15,13 @@
 
 #include "postgres.h"
 
+#include <ctype.h>
+
 #include "access/gin.h"
+#include "mb/pg_wchar.h"
+#include "nodes/pg_list.h"
+#include "tsearch/ts_type.h"
+#include "tsearch/ts_utils.h"
 #include "utils/builtins.h"
 #include "utils/jsonb.h"
 
@@ -24,7 +30,14 @@
 
 static ExtractedNode *recursiveExtract(JsQueryItem *jsq, bool not, bool indirect, PathItem *path);
 static ExtractedNode *makeAnyNode(bool not, bool indirect, PathItem *path);
-static int coundChildren(ExtractedNode *node, ExtractedNodeType type, bool first, bool *found);
+static ExtractedNode *makeAndNode(ExtractedNode *leftNode, ExtractedNode *rightNode, bool indirect, PathItem *path);
+static ExtractedNode *extractOperand(JsQueryItem *jsq, bool indirect, PathItem *path);
+static ExtractedNode *makeMatchNode(JsQueryItem *jsq, bool indirect, PathItem *path);
+static ExtractedNode *makeFtsNode(JsQueryItem *jsq, bool indirect, PathItem *path);
+static ExtractedNode *makeFoldedNode(JsQueryItem *jsq, bool indirect, PathItem *path);
+static List *getLikeFragments(char *s, int len);
+static List *getRegexFragments(char *s, int len);
+static int coundChildren(ExtractedNode *node, ExtractedNodeType type, bool first, bool *found, bool *lossy);
 static void fillChildren(ExtractedNode *node, ExtractedNodeType type, bool first, ExtractedNode **items, int *i);
 static void flatternTree(ExtractedNode *node);
 static int comparePathItems(PathItem *i1, PathItem *i2);
@@ -38,6 +51,10 @@ static void setSelectivityClass(ExtractedNode *node, CheckEntryHandler checkHand
 static void debugPath(StringInfo buf, PathItem *path);
 static void debugValue(StringInfo buf, JsQueryItem *v);
 static void debugRecursive(StringInfo buf, ExtractedNode *node, int shift);
+static bool needRecheckRecursive(ExtractedNode *node, bool indirect);
+static int countNodes(ExtractedNode *node);
+static void compileRecursive(ExtractedNode *node, CompiledItem *items, int *length);
+static uint64 execCompiledBits(CompiledQuery *query, uint64 *stack, int block);
 
 /*
  * Recursive function that turns jsquery into tree of ExtractedNode items.
@@ -84,16 +101,18 @@ recursiveExtract(JsQueryItem *jsq, bool not, bool indirect, PathItem *path)
 				if (leftNode)
 				{
 					leftNode->indirect = leftNode->indirect || indirect;
+					leftNode->lossy = true;
 					return leftNode;
 				}
 				else
 				{
 					rightNode->indirect = rightNode->indirect || indirect;
+					rightNode->lossy = true;
 					return rightNode;
 				}
 			}
 
-			result = (ExtractedNode *)palloc(sizeof(ExtractedNode));
+			result = (ExtractedNode *)palloc0(sizeof(ExtractedNode));
 			result->type = type;
 			result->path = path;
 			result->indirect = indirect;
@@ -132,15 +151,21 @@ recursiveExtract(JsQueryItem *jsq, bool not, bool indirect, PathItem *path)
 				return makeAnyNode(not, indirect, pathItem);
 			return recursiveExtract(&elem, not, true, pathItem);
 		case jqiAnyArray:
+		case jqiSliceArray:
 		case jqiAllArray:
-			if ((not && jsq->type == jqiAnyArray) || (!not && jsq->type == jqiAllArray))
+			/* elements of slice are handled like any element of array */
+			if ((not && jsq->type != jqiAllArray) || (!not && jsq->type == jqiAllArray))
 				return NULL;
 			pathItem = (PathItem *)palloc(sizeof(PathItem));
 			pathItem->type = iAnyArray;
 			pathItem->parent = path;
 			if (!jsqGetNext(jsq, &elem))
-				return makeAnyNode(not, indirect, pathItem);
-			return recursiveExtract(&elem, not, true, pathItem);
+				result = makeAnyNode(not, indirect, pathItem);
+			else
+				result = recursiveExtract(&elem, not, true, pathItem);
+			if (result && jsq->type == jqiSliceArray)
+				result->lossy = true;
+			return result;
 		case jqiAnyKey:
 		case jqiAllKey:
 			if ((not && jsq->type == jqiAnyKey) || (!not && jsq->type == jqiAllKey))
@@ -161,7 +186,7 @@ recursiveExtract(JsQueryItem *jsq, bool not, bool indirect, PathItem *path)
 			jsqGetArg(jsq, &e);
 			if (e.type == jqiAny)
 			{
-				result = (ExtractedNode *)palloc(sizeof(ExtractedNode));
+				result = (ExtractedNode *)palloc0(sizeof(ExtractedNode));
 				result->type = eAny;
 				result->hint = jsq->hint;
 				result->path = path;
@@ -170,7 +195,7 @@ recursiveExtract(JsQueryItem *jsq, bool not, bool indirect, PathItem *path)
 			}
 			else if (e.type != jqiArray)
 			{
-				result = (ExtractedNode *)palloc(sizeof(ExtractedNode));
+				result = (ExtractedNode *)palloc0(sizeof(ExtractedNode));
 				result->type = eExactValue;
 				result->hint = jsq->hint;
 				result->path = path;
@@ -187,12 +212,14 @@ recursiveExtract(JsQueryItem *jsq, bool not, bool indirect, PathItem *path)
 		case jqiContained:
 			if (not)
 				return NULL;
-			result = (ExtractedNode *)palloc(sizeof(ExtractedNode));
+			result = (ExtractedNode *)palloc0(sizeof(ExtractedNode));
 			result->type = (jsq->type == jqiContains || jsq->type == jqiEqual) ? eAnd : eOr;
 			jsqGetArg(jsq, &elem);
 			Assert(elem.type == jqiArray);
 			result->path = path;
 			result->indirect = indirect;
+			/* neither order nor count of elements is checked by the entries */
+			result->lossy = (jsq->type == jqiContained || jsq->type == jqiEqual);
 			result->args.items = (ExtractedNode **)palloc((elem.array.nelems + 1) * sizeof(ExtractedNode *));
 			result->args.count = 0;
 			if (jsq->type == jqiContains || jsq->type == jqiOverlap ||
@@ -210,7 +237,7 @@ recursiveExtract(JsQueryItem *jsq, bool not, bool indirect, PathItem *path)
 			if (jsq->type == jqiContained ||
 					(jsq->type == jqiEqual && elem.array.nelems == 0))
 			{
-				ExtractedNode *item = (ExtractedNode *)palloc(sizeof(ExtractedNode));
+				ExtractedNode *item = (ExtractedNode *)palloc0(sizeof(ExtractedNode));
 
 				item->hint = e.hint;
 				item->type = eEmptyArray;
@@ -224,7 +251,7 @@ recursiveExtract(JsQueryItem *jsq, bool not, bool indirect, PathItem *path)
 
 			while(jsqIterateArray(&elem, &e))
 			{
-				ExtractedNode *item = (ExtractedNode *)palloc(sizeof(ExtractedNode));
+				ExtractedNode *item = (ExtractedNode *)palloc0(sizeof(ExtractedNode));
 
 				item->hint = e.hint;
 				item->type = eExactValue;
@@ -244,7 +271,7 @@ recursiveExtract(JsQueryItem *jsq, bool not, bool indirect, PathItem *path)
 		case jqiGreaterOrEqual:
 			if (not)
 				return NULL;
-			result = (ExtractedNode *)palloc(sizeof(ExtractedNode));
+			result = (ExtractedNode *)palloc0(sizeof(ExtractedNode));
 			result->type = eInequality;
 			result->hint = jsq->hint;
 			result->path = path;
@@ -270,15 +297,50 @@ recursiveExtract(JsQueryItem *jsq, bool not, bool indirect, PathItem *path)
 		case jqiIs:
 			if (not)
 				return NULL;
-			result = (ExtractedNode *)palloc(sizeof(ExtractedNode));
+			result = (ExtractedNode *)palloc0(sizeof(ExtractedNode));
 			result->type = eIs;
 			result->hint = jsq->hint;
 			result->path = path;
 			result->indirect = indirect;
 			result->isType = jsqGetIsType(jsq);
 			return result;
+		case jqiRegex:
+		case jqiLike:
+			if (not)
+				return NULL;
+			return makeMatchNode(jsq, indirect, path);
+		case jqiFts:
+			if (not)
+				return NULL;
+			return makeFtsNode(jsq, indirect, path);
+		case jqiIEqual:
+			if (not)
+				return NULL;
+			return makeFoldedNode(jsq, indirect, path);
 		case jqiLength:
 			return NULL;
+		case jqiPath:
+		case jqiAdd:
+		case jqiSub:
+		case jqiMul:
+		case jqiDiv:
+			/*
+			 * Values of computed operands are unknown, but paths they refer
+			 * to have to exist.
+			 */
+			if (not)
+				return NULL;
+			leftNode = extractOperand(jsq, indirect, path);
+			rightNode = NULL;
+			if (jsqGetNext(jsq, &elem) && elem.type != jqiIs)
+			{
+				jsqGetArg(&elem, &e);
+				rightNode = extractOperand(&e, indirect, path);
+			}
+			result = makeAndNode(leftNode, rightNode, indirect, path);
+			if (result)
+				result->lossy = true;
+			return result;
 		default:
 			elog(ERROR,"Wrong state: %d", jsq->type);
 	}
@@ -286,6 +348,62 @@ recursiveExtract(JsQueryItem *jsq, bool not, bool indirect, PathItem *path)
 	return NULL;
 }
 
+/*
+ * Make conjunction of nodes, any of them could be NULL.
+ */
+static ExtractedNode *
+makeAndNode(ExtractedNode *leftNode, ExtractedNode *rightNode, bool indirect,
+			PathItem *path)
+{
+	ExtractedNode  *result;
+
+	if (!leftNode)
+		return rightNode;
+	if (!rightNode)
+		return leftNode;
+
+	result = (ExtractedNode *)palloc0(sizeof(ExtractedNode));
+	result->type = eAnd;
+	result->path = path;
+	result->indirect = indirect;
+	result->args.items = (ExtractedNode **)palloc(2 * sizeof(ExtractedNode *));
+	result->args.items[0] = leftNode;
+	result->args.items[1] = rightNode;
+	result->args.count = 2;
+	return result;
+}
+
+/*
+ * Extract existence of paths referred by operand of computed expression.
+ * Constants don't produce anything.
+ */
+static ExtractedNode *
+extractOperand(JsQueryItem *jsq, bool indirect, PathItem *path)
+{
+	ExtractedNode	*leftNode, *rightNode;
+	JsQueryItem		elem;
+
+	check_stack_depth();
+
+	switch(jsq->type)
+	{
+		case jqiPath:
+			jsqGetArg(jsq, &elem);
+			return recursiveExtract(&elem, false, indirect, path);
+		case jqiAdd:
+		case jqiSub:
+		case jqiMul:
+		case jqiDiv:
+			jsqGetLeftArg(jsq, &elem);
+			leftNode = extractOperand(&elem, indirect, path);
+			jsqGetRightArg(jsq, &elem);
+			rightNode = extractOperand(&elem, indirect, path);
+			return makeAndNode(leftNode, rightNode, indirect, path);
+		default:
+			return NULL;
+	}
+}
+
 /*
  * Make node for checking existence of path.
  */
@@ -297,7 +415,7 @@ makeAnyNode(bool not, bool indirect, PathItem *path)
 	if (not)
 		return NULL;
 
-	result = (ExtractedNode *) palloc(sizeof(ExtractedNode));
+	result = (ExtractedNode *) palloc0(sizeof(ExtractedNode));
 	result->type = eAny;
 	result->hint = false;
 	result->path = path;
@@ -305,12 +423,427 @@ makeAnyNode(bool not, bool indirect, PathItem *path)
 	return result;
 }
 
+/*
+ * Add current fragment to the list of fragments if it's not empty.
+ */
+static List *
+addFragment(List *fragments, StringInfo *fragment)
+{
+	if ((*fragment)->len > 0)
+	{
+		fragments = lappend(fragments, *fragment);
+		*fragment = makeStringInfo();
+	}
+	return fragments;
+}
+
+/*
+ * Get literal fragments of LIKE pattern.  Every string matching the pattern
+ * contains all of them.
+ */
+static List *
+getLikeFragments(char *s, int len)
+{
+	List	   *fragments = NIL;
+	StringInfo	fragment = makeStringInfo();
+	char	   *end = s + len;
+
+	while (s < end)
+	{
+		int		clen;
+
+		if (*s == '%' || *s == '_')
+		{
+			fragments = addFragment(fragments, &fragment);
+			s++;
+			continue;
+		}
+
+		/* backslash escapes next character */
+		if (*s == '\\' && s + 1 < end)
+			s++;
+
+		clen = Min(pg_mblen(s), end - s);
+		appendBinaryStringInfo(fragment, s, clen);
+		s += clen;
+	}
+
+	return addFragment(fragments, &fragment);
+}
+
+/*
+ * Get literal fragments of regular expression.  Every string matching the
+ * regular expression contains all of them.  Only literal characters outside
+ * of parentheses and brackets are taken into account.  Patterns containing
+ * alternation or embedded options are given up, so result is conservative.
+ */
+static List *
+getRegexFragments(char *s, int len)
+{
+	List	   *fragments = NIL;
+	StringInfo	fragment = makeStringInfo();
+	char	   *end = s + len;
+	char	   *p;
+	int			depth = 0,
+				lastLen = 0;
+
+	if (len >= 3 && memcmp(s, "***", 3) == 0)
+		return NIL;
+
+	for (p = s; p < end; p++)
+		if (*p == '|' || (*p == '(' && p + 1 < end && p[1] == '?'))
+			return NIL;
+
+	while (s < end)
+	{
+		switch (*s)
+		{
+			case '(':
+				fragments = addFragment(fragments, &fragment);
+				lastLen = 0;
+				depth++;
+				s++;
+				break;
+			case ')':
+				if (depth > 0)
+					depth--;
+				s++;
+				break;
+			case '*':
+			case '?':
+			case '{':
+				/* previous character is optional */
+				if (lastLen > 0)
+				{
+					fragment->len -= lastLen;
+					fragment->data[fragment->len] = '\0';
+				}
+				fragments = addFragment(fragments, &fragment);
+				lastLen = 0;
+				if (*s == '{')
+				{
+					while (s < end && *s != '}')
+						s++;
+				}
+				s++;
+				break;
+			case '+':
+			case '.':
+			case '^':
+			case '$':
+				fragments = addFragment(fragments, &fragment);
+				lastLen = 0;
+				s++;
+				break;
+			case '[':
+				fragments = addFragment(fragments, &fragment);
+				lastLen = 0;
+				s++;
+				if (s < end && *s == '^')
+					s++;
+				if (s < end && *s == ']')
+					s++;
+				while (s < end && *s != ']')
+				{
+					if (*s == '\\')
+					{
+						s++;
+					}
+					else if (*s == '[' && s + 1 < end &&
+							 (s[1] == ':' || s[1] == '.' || s[1] == '='))
+					{
+						/* skip character class, collating element or equivalence class */
+						char	delim = s[1];
+
+						s += 2;
+						while (s + 1 < end && !(s[0] == delim && s[1] == ']'))
+							s++;
+						s++;
+					}
+					s++;
+				}
+				s++;
+				break;
+			case '\\':
+				s++;
+				if (s < end && !isalnum((unsigned char) *s))
+				{
+					/* escaped non-alphanumeric character is literal */
+					lastLen = Min(pg_mblen(s), end - s);
+					if (depth == 0)
+						appendBinaryStringInfo(fragment, s, lastLen);
+					else
+						lastLen = 0;
+					s += Min(pg_mblen(s), end - s);
+				}
+				else
+				{
+					/* class-shorthand, constraint or character entry escape */
+					fragments = addFragment(fragments, &fragment);
+					lastLen = 0;
+					while (s < end && isalnum((unsigned char) *s))
+						s++;
+				}
+				break;
+			default:
+				lastLen = Min(pg_mblen(s), end - s);
+				if (depth == 0)
+					appendBinaryStringInfo(fragment, s, lastLen);
+				else
+					lastLen = 0;
+				s += Min(pg_mblen(s), end - s);
+				break;
+		}
+	}
+
+	return addFragment(fragments, &fragment);
+}
+
+/*
+ * Make node for regex or LIKE match.  Matched value is always a string and
+ * contains every trigram of literal fragments of pattern.
+ */
+static ExtractedNode *
+makeMatchNode(JsQueryItem *jsq, bool indirect, PathItem *path)
+{
+	ExtractedNode  *result;
+	JsQueryItem		e;
+	List		   *fragments,
+				   *items;
+	ListCell	   *lc;
+	char		   *s;
+	int32			len;
+	int				i;
+
+	result = (ExtractedNode *)palloc0(sizeof(ExtractedNode));
+	result->type = eIs;
+	result->hint = jsq->hint;
+	result->path = path;
+	result->indirect = indirect;
+	result->isType = jbvString;
+
+	jsqGetArg(jsq, &e);
+	if (e.type != jqiString)
+		return result;
+
+	s = jsqGetString(&e, &len);
+	if (jsq->type == jqiLike)
+		fragments = getLikeFragments(s, len);
+	else
+		fragments = getRegexFragments(s, len);
+
+	items = list_make1(result);
+	foreach(lc, fragments)
+	{
+		StringInfo	fragment = (StringInfo) lfirst(lc);
+		char	   *f = fragment->data,
+				   *fend = fragment->data + fragment->len;
+
+		while (f < fend)
+		{
+			ExtractedNode  *item;
+			char		   *p = f;
+			int				n;
+
+			for (n = 0; n < 3 && p < fend; n++)
+				p += pg_mblen(p);
+			if (n < 3 || p > fend)
+				break;
+
+			item = (ExtractedNode *)palloc0(sizeof(ExtractedNode));
+			item->type = eTrigram;
+			item->hint = jsq->hint;
+			item->path = path;
+			item->indirect = indirect;
+			item->string.val = f;
+			item->string.len = p - f;
+			items = lappend(items, item);
+
+			f += pg_mblen(f);
+		}
+	}
+
+	if (list_length(items) == 1)
+		return result;
+
+	result = (ExtractedNode *)palloc0(sizeof(ExtractedNode));
+	result->type = eAnd;
+	result->hint = jsq->hint;
+	result->path = path;
+	result->indirect = indirect;
+	result->args.count = list_length(items);
+	result->args.items = (ExtractedNode **)palloc(result->args.count * sizeof(ExtractedNode *));
+	i = 0;
+	foreach(lc, items)
+		result->args.items[i++] = (ExtractedNode *) lfirst(lc);
+
+	return result;
+}
+
+/*
+ * Make node for lexemes of full text search query item.  NOT operands and
+ * prefix lexemes can't be checked using exact lexeme entries, so they give no
+ * restriction.  Phrase operator implies all its operands are present.
+ */
+static ExtractedNode *
+makeLexemeNode(TSQuery query, QueryItem *item, Oid cfgId, JsQueryItem *jsq,
+			   bool indirect, PathItem *path)
+{
+	ExtractedNode  *result,
+				   *left,
+				   *right;
+
+	check_stack_depth();
+
+	if (item->type == QI_VAL)
+	{
+		QueryOperand   *operand = &item->qoperand;
+
+		if (operand->prefix)
+			return NULL;
+
+		result = (ExtractedNode *)palloc0(sizeof(ExtractedNode));
+		result->type = eLexeme;
+		result->hint = jsq->hint;
+		result->path = path;
+		result->indirect = indirect;
+		result->string.val = GETOPERAND(query) + operand->distance;
+		result->string.len = operand->length;
+		result->string.cfgId = cfgId;
+		return result;
+	}
+
+	if (item->qoperator.oper == OP_NOT)
+		return NULL;
+
+	left = makeLexemeNode(query, item + item->qoperator.left, cfgId,
+						  jsq, indirect, path);
+	right = makeLexemeNode(query, item + 1, cfgId, jsq, indirect, path);
+
+	if (item->qoperator.oper == OP_OR)
+	{
+		if (!left || !right)
+			return NULL;
+	}
+	else
+	{
+		if (!left)
+			return right;
+		if (!right)
+			return left;
+	}
+
+	result = (ExtractedNode *)palloc0(sizeof(ExtractedNode));
+	result->type = (item->qoperator.oper == OP_OR) ? eOr : eAnd;
+	result->hint = jsq->hint;
+	result->path = path;
+	result->indirect = indirect;
+	result->args.count = 2;
+	result->args.items = (ExtractedNode **)palloc(2 * sizeof(ExtractedNode *));
+	result->args.items[0] = left;
+	result->args.items[1] = right;
+	return result;
+}
+
+/*
+ * Make node for full text search match.  Matched value is always a string and
+ * contains lexemes required by the query.  Query is parsed with text search
+ * configuration given in the item, the same way executor does.  Lexemes
+ * remember the configuration, since index can only supply lexemes of its own.
+ */
+static ExtractedNode *
+makeFtsNode(JsQueryItem *jsq, bool indirect, PathItem *path)
+{
+	ExtractedNode  *result,
+				   *lexemes,
+				   *node;
+	JsQueryItem		config,
+					e;
+	TSQuery			query;
+	Oid				cfgId;
+	char		   *s;
+	int32			len;
+
+	result = (ExtractedNode *)palloc0(sizeof(ExtractedNode));
+	result->type = eIs;
+	result->hint = jsq->hint;
+	result->path = path;
+	result->indirect = indirect;
+	result->isType = jbvString;
+
+	jsqGetLeftArg(jsq, &config);
+	jsqGetRightArg(jsq, &e);
+
+	cfgId = jsqGetTSConfig(&config);
+	s = jsqGetString(&e, &len);
+	query = DatumGetTSQuery(DirectFunctionCall2(to_tsquery_byid,
+								ObjectIdGetDatum(cfgId),
+								PointerGetDatum(cstring_to_text_with_len(s, len))));
+
+	/* query consisting only of stopwords */
+	if (query->size == 0)
+		return result;
+
+	lexemes = makeLexemeNode(query, GETQUERY(query), cfgId, jsq, indirect, path);
+	if (!lexemes)
+		return result;
+
+	node = (ExtractedNode *)palloc0(sizeof(ExtractedNode));
+	node->type = eAnd;
+	node->hint = jsq->hint;
+	node->path = path;
+	node->indirect = indirect;
+	node->args.count = 2;
+	node->args.items = (ExtractedNode **)palloc(2 * sizeof(ExtractedNode *));
+	node->args.items[0] = result;
+	node->args.items[1] = lexemes;
+	return node;
+}
+
+/*
+ * Make node for case-insensitive equality.  Matched value is always a string,
+ * and it's equal to the given one after case folding.
+ */
+static ExtractedNode *
+makeFoldedNode(JsQueryItem *jsq, bool indirect, PathItem *path)
+{
+	ExtractedNode  *result,
+				   *folded,
+				   *node;
+
+	result = (ExtractedNode *)palloc0(sizeof(ExtractedNode));
+	result->type = eIs;
+	result->hint = jsq->hint;
+	result->path = path;
+	result->indirect = indirect;
+	result->isType = jbvString;
+
+	folded = (ExtractedNode *)palloc0(sizeof(ExtractedNode));
+	folded->type = eFolded;
+	folded->hint = jsq->hint;
+	folded->path = path;
+	folded->indirect = indirect;
+	folded->exactValue = (JsQueryItem *)palloc(sizeof(JsQueryItem));
+	jsqGetArg(jsq, folded->exactValue);
+
+	node = (ExtractedNode *)palloc0(sizeof(ExtractedNode));
+	node->type = eAnd;
+	node->hint = jsq->hint;
+	node->path = path;
+	node->indirect = indirect;
+	node->args.count = 2;
+	node->args.items = (ExtractedNode **)palloc(2 * sizeof(ExtractedNode *));
+	node->args.items[0] = result;
+	node->args.items[1] = folded;
+	return node;
+}
+
 /*
  * Count number of children connected with nodes of same type.
  */
 static int
 coundChildren(ExtractedNode *node, ExtractedNodeType type,
-													bool first, bool *found)
+										bool first, bool *found, bool *lossy)
 {
 	if ((node->indirect || node->type != type) && !first)
 	{
@@ -321,8 +854,10 @@ coundChildren(ExtractedNode *node, ExtractedNodeType type,
 		int i, total = 0;
 		if (!first)
 			*found = true;
+		*lossy = *lossy || node->lossy;
 		for (i = 0; i < node->args.count; i++)
-			total += coundChildren(node->args.items[i], type, false, found);
+			total += coundChildren(node->args.items[i], type, false, found,
+								   lossy);
 		return total;
 	}
 }
@@ -357,9 +892,10 @@ flatternTree(ExtractedNode *node)
 	if (node->type == eAnd || node->type == eOr)
 	{
 		int count;
-		bool found = false;
+		bool found = false,
+			 lossy = false;
 
-		count = coundChildren(node, node->type, true, &found);
+		count = coundChildren(node, node->type, true, &found, &lossy);
 
 		if (found)
 		{
@@ -368,6 +904,7 @@ flatternTree(ExtractedNode *node)
 			fillChildren(node, node->type, true, items, &i);
 			node->args.items = items;
 			node->args.count = count;
+			node->lossy = lossy;
 		}
 	}
 	if (node->type == eAnd || node->type == eOr)
@@ -613,6 +1150,9 @@ processGroup(ExtractedNode *node, int start, int end)
 			break;
 	}
 
+	/* merged conditions aren't checked one by one anymore */
+	child->lossy = true;
+
 	for (i = start + 1; i < end; i++)
 		node->args.items[i] = NULL;
 }
@@ -638,7 +1178,9 @@ simplifyRecursive(ExtractedNode *node)
 		for (i = 0; i < node->args.count; i++)
 		{
 			child = node->args.items[i];
-			if (child->indirect || isLogicalNodeType(child->type))
+			if (child->indirect || isLogicalNodeType(child->type) ||
+				child->type == eTrigram || child->type == eLexeme ||
+				child->type == eFolded)
 				break;
 			if (!prevChild || comparePathItems(child->path, prevChild->path) != 0)
 			{
@@ -684,6 +1226,11 @@ getScalarSelectivityClass(ExtractedNode *node)
 		case eEmptyArray:
 		case eExactValue:
 			return sEqual;
+		case eTrigram:
+			return sRange;
+		case eLexeme:
+		case eFolded:
+			return sEqual;
 		default:
 			elog(ERROR, "Wrong state");
 			return sAny;
@@ -709,7 +1256,10 @@ makeEntries(ExtractedNode *node, MakeEntryHandler handler, Pointer extra)
 			if (child->sClass > node->sClass &&
 				node->type == eAnd &&
 				!child->forceIndex)
+			{
+				node->lossy = true;
 				continue;
+			}
 			child = makeEntries(child, handler, extra);
 			if (child)
 			{
@@ -720,10 +1270,16 @@ makeEntries(ExtractedNode *node, MakeEntryHandler handler, Pointer extra)
 			{
 				return NULL;
 			}
+			else
+			{
+				node->lossy = true;
+			}
 		}
 		if (j == 1)
 		{
-			return node->args.items[0];
+			child = node->args.items[0];
+			child->lossy = child->lossy || node->lossy;
+			return child;
 		}
 		if (j > 0)
 		{
@@ -801,6 +1357,9 @@ setSelectivityClass(ExtractedNode *node, CheckEntryHandler checkHandler,
 				}
 				first = false;
 			}
+			/* none of children could be evaluated using index */
+			if (first)
+				node->sClass = sAny;
 			break;
 		default:
 			node->sClass = getScalarSelectivityClass(node);
@@ -832,61 +1391,56 @@ extractJsQuery(JsQuery *jq, MakeEntryHandler makeHandler,
 }
 
 /*
- * Evaluate previously extracted tree.
+ * Check if extracted tree is weaker than query itself: some parts of query
+ * were skipped or evaluated approximately.  Conjunctions inside an array
+ * element can be satisfied by different elements, so they are lossy too.
+ * Only exact scalar values are considered, because strings are hashed.
  */
-bool
-execRecursive(ExtractedNode *node, bool *check)
+static bool
+needRecheckRecursive(ExtractedNode *node, bool indirect)
 {
-	int i;
+	PathItem   *pathItem;
+	int			i;
+
+	check_stack_depth();
+
+	if (node->lossy)
+		return true;
+
+	indirect = indirect || node->indirect;
+
 	switch(node->type)
 	{
 		case eAnd:
-			for (i = 0; i < node->args.count; i++)
-				if (!execRecursive(node->args.items[i], check))
-					return false;
-			return true;
 		case eOr:
+			if (node->type == eAnd && indirect)
+				return true;
 			for (i = 0; i < node->args.count; i++)
-				if (execRecursive(node->args.items[i], check))
+				if (needRecheckRecursive(node->args.items[i], indirect))
+					return true;
+			return false;
+		case eExactValue:
+			if (node->exactValue->type != jqiNumeric &&
+				node->exactValue->type != jqiBool &&
+				node->exactValue->type != jqiNull)
+				return true;
+			for (pathItem = node->path; pathItem; pathItem = pathItem->parent)
+				if (pathItem->type != iKey && pathItem->type != iAnyArray)
 					return true;
 			return false;
 		default:
-			return check[node->entryNum];
+			return true;
 	}
 }
 
 /*
- * Evaluate previously extracted tree using tri-state logic.
+ * Check if items matching all the entries of extracted tree still have to
+ * be checked against the query.
  */
 bool
-execRecursiveTristate(ExtractedNode *node, GinTernaryValue *check)
+queryNeedRecheck(ExtractedNode *node)
 {
-	GinTernaryValue	res, v;
-	int i;
-
-	switch(node->type)
-	{
-		case eAnd:
-			res = GIN_TRUE;
-			for (i = 0; i < node->args.count; i++)
-			{
-				v = execRecursiveTristate(node->args.items[i], check);
-				if (v == GIN_FALSE)
-					return GIN_FALSE;
-			}
-			return res;
-		case eOr:
-			res = GIN_FALSE;
-			for (i = 0; i < node->args.count; i++)
-			{
-				v = execRecursiveTristate(node->args.items[i], check);
-				if (v == GIN_TRUE)
-					return GIN_TRUE;
-			}
-			return res;
-		default:
-			return check[node->entryNum];
-	}
+	return needRecheckRecursive(node, false);
 }
 
 /*
@@ -1009,6 +1563,11 @@ debugRecursive(StringInfo buf, ExtractedNode *node, int shift)
 			debugValue(buf, node->exactValue);
 			appendStringInfo(buf, " ,");
 			break;
+		case eFolded:
+			appendStringInfo(buf, " ~= ");
+			debugValue(buf, node->exactValue);
+			appendStringInfo(buf, " ,");
+			break;
 		case eAny:
 			appendStringInfo(buf, " = * ,");
 			break;
@@ -1018,6 +1577,16 @@ debugRecursive(StringInfo buf, ExtractedNode *node, int shift)
 		case eIs:
 			appendStringInfo(buf, " IS %s ,", getTypeString(node->isType));
 			break;
+		case eTrigram:
+			appendStringInfo(buf, " TRIGRAM \"");
+			appendBinaryStringInfo(buf, node->string.val, node->string.len);
+			appendStringInfo(buf, "\" ,");
+			break;
+		case eLexeme:
+			appendStringInfo(buf, " LEXEME \"");
+			appendBinaryStringInfo(buf, node->string.val, node->string.len);
+			appendStringInfo(buf, "\" ,");
+			break;
 		case eInequality:
 			if (node->bounds.leftBound)
 			{
@@ -1064,3 +1633,244 @@ debugJsQuery(JsQuery *jq, MakeEntryHandler makeHandler,
 	appendStringInfoChar(&buf, '\0');
 	return buf.data;
 }
+
+/*
+ * Count nodes of extracted tree.
+ */
+static int
+countNodes(ExtractedNode *node)
+{
+	int i, count = 1;
+
+	if (node->type == eAnd || node->type == eOr)
+		for (i = 0; i < node->args.count; i++)
+			count += countNodes(node->args.items[i]);
+	return count;
+}
+
+/*
+ * Put extracted tree into program in postfix order: arguments of AND/OR
+ * go before the operator itself.
+ */
+static void
+compileRecursive(ExtractedNode *node, CompiledItem *items, int *length)
+{
+	int i;
+
+	check_stack_depth();
+
+	if (node->type == eAnd || node->type == eOr)
+	{
+		for (i = 0; i < node->args.count; i++)
+			compileRecursive(node->args.items[i], items, length);
+		items[*length].arg = node->args.count;
+	}
+	else
+	{
+		items[*length].arg = node->entryNum;
+	}
+	items[*length].type = node->type;
+	(*length)++;
+}
+
+/*
+ * Evaluate program for 64 combinations of entries at once: bit number i of
+ * result corresponds to bitmap of present entries equal to (block * 64 + i).
+ */
+static uint64
+execCompiledBits(CompiledQuery *query, uint64 *stack, int block)
+{
+	static const uint64 patterns[] = {
+		UINT64CONST(0xAAAAAAAAAAAAAAAA),
+		UINT64CONST(0xCCCCCCCCCCCCCCCC),
+		UINT64CONST(0xF0F0F0F0F0F0F0F0),
+		UINT64CONST(0xFF00FF00FF00FF00),
+		UINT64CONST(0xFFFF0000FFFF0000),
+		UINT64CONST(0xFFFFFFFF00000000)
+	};
+	CompiledItem   *item;
+	uint64			v;
+	int				i, j, sp = 0;
+
+	for (i = 0; i < query->length; i++)
+	{
+		item = &query->items[i];
+		switch(item->type)
+		{
+			case eAnd:
+				sp -= item->arg;
+				v = ~UINT64CONST(0);
+				for (j = 0; j < item->arg; j++)
+					v &= stack[sp + j];
+				break;
+			case eOr:
+				sp -= item->arg;
+				v = UINT64CONST(0);
+				for (j = 0; j < item->arg; j++)
+					v |= stack[sp + j];
+				break;
+			default:
+				if (item->arg < 6)
+					v = patterns[item->arg];
+				else
+					v = ((block >> (item->arg - 6)) & 1) ? ~UINT64CONST(0) : 0;
+				break;
+		}
+		stack[sp++] = v;
+	}
+	return stack[0];
+}
+
+/*
+ * Compile extracted tree for fast evaluation by consistent functions, which
+ * are called for every candidate item.
+ */
+CompiledQuery *
+compileExtractedTree(ExtractedNode *root, int nentries)
+{
+	CompiledQuery  *query;
+	int				length = 0;
+
+	query = (CompiledQuery *) palloc(sizeof(CompiledQuery));
+	query->nentries = nentries;
+	query->length = countNodes(root);
+	query->items = (CompiledItem *) palloc(query->length * sizeof(CompiledItem));
+	query->stack = (GinTernaryValue *) palloc(query->length * sizeof(GinTernaryValue));
+	compileRecursive(root, query->items, &length);
+	Assert(length == query->length);
+
+	if (nentries <= JSQ_TRUTH_TABLE_MAX_ENTRIES)
+	{
+		int		nblocks = (nentries > 6) ? (1 << (nentries - 6)) : 1,
+				block;
+		uint64 *stack;
+
+		stack = (uint64 *) palloc(query->length * sizeof(uint64));
+		query->truthTable = (uint64 *) palloc(nblocks * sizeof(uint64));
+		for (block = 0; block < nblocks; block++)
+			query->truthTable[block] = execCompiledBits(query, stack, block);
+		pfree(stack);
+	}
+	else
+	{
+		query->truthTable = NULL;
+	}
+
+	return query;
+}
+
+/*
+ * Evaluate compiled tree.
+ */
+bool
+execCompiled(CompiledQuery *query, bool *check)
+{
+	GinTernaryValue	   *stack = query->stack;
+	CompiledItem	   *item;
+	bool				res;
+	int					i, j, sp = 0;
+
+	if (query->truthTable)
+	{
+		uint32	index = 0;
+
+		for (i = 0; i < query->nentries; i++)
+			if (check[i])
+				index |= (uint32) 1 << i;
+		return (query->truthTable[index / 64] >> (index % 64)) & 1;
+	}
+
+	for (i = 0; i < query->length; i++)
+	{
+		item = &query->items[i];
+		switch(item->type)
+		{
+			case eAnd:
+				sp -= item->arg;
+				res = true;
+				for (j = 0; j < item->arg; j++)
+					res = res && stack[sp + j];
+				break;
+			case eOr:
+				sp -= item->arg;
+				res = false;
+				for (j = 0; j < item->arg; j++)
+					res = res || stack[sp + j];
+				break;
+			default:
+				res = check[item->arg];
+				break;
+		}
+		stack[sp++] = res;
+	}
+	return stack[0];
+}
+
+/*
+ * Evaluate compiled tree using tri-state logic.  GIN_MAYBE propagates unless
+ * it's overridden: AND is false when any of arguments is false, OR is true
+ * when any of arguments is true.  That lets GIN fast scan skip items which
+ * can't match whatever unknown entries are.  Truth table is used only when
+ * none of entries is GIN_MAYBE.
+ */
+GinTernaryValue
+execCompiledTristate(CompiledQuery *query, GinTernaryValue *check)
+{
+	GinTernaryValue	   *stack = query->stack;
+	CompiledItem	   *item;
+	GinTernaryValue		res, v;
+	int					i, j, sp = 0;
+
+	if (query->truthTable)
+	{
+		uint32	index = 0;
+
+		for (i = 0; i < query->nentries; i++)
+		{
+			if (check[i] == GIN_MAYBE)
+				break;
+			if (check[i] == GIN_TRUE)
+				index |= (uint32) 1 << i;
+		}
+		if (i >= query->nentries)
+			return ((query->truthTable[index / 64] >> (index % 64)) & 1) ?
+															GIN_TRUE : GIN_FALSE;
+	}
+
+	for (i = 0; i < query->length; i++)
+	{
+		item = &query->items[i];
+		switch(item->type)
+		{
+			case eAnd:
+				sp -= item->arg;
+				res = GIN_TRUE;
+				for (j = 0; j < item->arg; j++)
+				{
+					v = stack[sp + j];
+					if (v == GIN_FALSE)
+						res = GIN_FALSE;
+					else if (v == GIN_MAYBE && res == GIN_TRUE)
+						res = GIN_MAYBE;
+				}
+				break;
+			case eOr:
+				sp -= item->arg;
+				res = GIN_FALSE;
+				for (j = 0; j < item->arg; j++)
+				{
+					v = stack[sp + j];
+					if (v == GIN_TRUE)
+						res = GIN_TRUE;
+					else if (v == GIN_MAYBE && res == GIN_FALSE)
+						res = GIN_MAYBE;
+				}
+				break;
+			default:
+				res = check[item->arg];
+				break;
+		}
+		stack[sp++] = res;
+	}
+	return stack[0];
+}
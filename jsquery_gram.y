@@ -66,6 +66,24 @@ makeItemType(int type)
 	return v;
 }
 
+/*
+ * Sign of number is scanned as a separate token, since "+" and "-" are
+ * arithmetic operations too.  Glue it back to the number.
+ */
+static string
+makeSignedNumber(char sign, string *s)
+{
+	string	res;
+
+	res.len = s->len + 1;
+	res.total = res.len + 1;
+	res.val = palloc(res.total);
+	res.val[0] = sign;
+	memcpy(res.val + 1, s->val, s->len + 1);	/* with trailing '\0' */
+
+	return res;
+}
+
 static JsQueryParseItem*
 makeIndexArray(string *s)
 {
@@ -80,6 +98,22 @@ makeIndexArray(string *s)
 	return v;
 }
 
+static JsQueryParseItem*
+makeSliceArray(string *start, string *end)
+{
+	JsQueryParseItem* v = makeItemType(jqiSliceArray);
+
+#if PG_VERSION_NUM >= 120000
+	v->slice.start = pg_strtoint32(start->val);
+	v->slice.end = (end) ? pg_strtoint32(end->val) : JSQ_SLICE_END;
+#else
+	v->slice.start = pg_atoi(start->val, 4, 0);
+	v->slice.end = (end) ? pg_atoi(end->val, 4, 0) : JSQ_SLICE_END;
+#endif
+
+	return v;
+}
+
 static JsQueryParseItem*
 makeItemString(string *s)
 {
@@ -176,6 +210,117 @@ makeItemUnary(int type, JsQueryParseItem* a)
 	return v;
 }
 
+/*
+ * Full text search item keeps name of text search configuration as its left
+ * argument, so the match never depends on default_text_search_config.
+ */
+static JsQueryParseItem*
+makeItemFts(string *config, string *query)
+{
+	string		defaultConfig;
+
+	if (config == NULL)
+	{
+		defaultConfig.val = JSQ_DEFAULT_TS_CONFIG;
+		defaultConfig.len = strlen(JSQ_DEFAULT_TS_CONFIG);
+		config = &defaultConfig;
+	}
+
+	/* complain about unknown configuration right away */
+	(void) DirectFunctionCall1(regconfigin, CStringGetDatum(config->val));
+
+	return makeItemBinary(jqiFts, makeItemString(config), makeItemString(query));
+}
+
+/*
+ * Arithmetic operation over constants is evaluated right away, so it doesn't
+ * prevent the index usage.
+ */
+static JsQueryParseItem*
+makeItemArithmetic(int type, JsQueryParseItem* la, JsQueryParseItem *ra)
+{
+	PGFunction	func;
+
+	if (la->type != jqiNumeric || ra->type != jqiNumeric)
+		return makeItemBinary(type, la, ra);
+
+	switch(type)
+	{
+		case jqiAdd:
+			func = numeric_add;
+			break;
+		case jqiSub:
+			func = numeric_sub;
+			break;
+		case jqiMul:
+			func = numeric_mul;
+			break;
+		case jqiDiv:
+			func = numeric_div;
+			break;
+		default:
+			elog(ERROR, "Unknown operation");
+			func = NULL; /* keep compiler quiet */
+	}
+
+	la->numeric = DatumGetNumeric(DirectFunctionCall2(func,
+									NumericGetDatum(la->numeric),
+									NumericGetDatum(ra->numeric)));
+
+	return la;
+}
+
+/*
+ * Path used as operand of computed expression selects list of values, and
+ * comparison matches if any pair of them matches.  "All" quantifiers can't be
+ * evaluated this way, so they are rejected.
+ */
+static JsQueryParseItem*
+makeItemPath(List *path)
+{
+	ListCell	*cell;
+
+	foreach(cell, path)
+	{
+		JsQueryParseItem	*c = (JsQueryParseItem*)lfirst(cell);
+
+		if (c->type == jqiAll || c->type == jqiAllArray || c->type == jqiAllKey)
+			ereport(ERROR,
+					(errcode(ERRCODE_SYNTAX_ERROR),
+					 errmsg("bad jsquery representation"),
+					 errdetail("\"all\" quantifiers are not allowed in computed operands")));
+	}
+
+	return makeItemUnary(jqiPath, makeItemList(path));
+}
+
+/*
+ * Make "path operation" expression.  When right operand refers to the
+ * document, left path is evaluated as a reference too, so both of them are
+ * resolved from the same value.
+ */
+static JsQueryParseItem*
+makeItemExpr(List *path, JsQueryParseItem *op)
+{
+	switch(op->type)
+	{
+		case jqiEqual:
+		case jqiLess:
+		case jqiGreater:
+		case jqiLessOrEqual:
+		case jqiGreaterOrEqual:
+			if (op->arg->type == jqiPath || op->arg->type == jqiAdd ||
+				op->arg->type == jqiSub || op->arg->type == jqiMul ||
+				op->arg->type == jqiDiv)
+				return makeItemList(lappend(lappend(NIL, makeItemPath(path)), op));
+			break;
+		default:
+			break;
+	}
+
+	return makeItemList(lappend(path, op));
+}
+
 static JsQueryParseItem*
 makeItemIs(int isType)
 {
@@ -232,23 +377,30 @@ makeItemList(List *list) {
 
 %token	<str>		IN_P IS_P OR_P AND_P NOT_P NULL_P TRUE_P
 					ARRAY_T FALSE_P NUMERIC_T OBJECT_T
-					STRING_T BOOLEAN_T
+					STRING_T BOOLEAN_T LIKE_P
 
 %token	<str>		STRING_P NUMERIC_P INT_P
 
 %type	<value>		result scalar_value
 
+%type	<str>		array_index signed_number
+
 %type	<elems>		path value_list
 
 %type	<value>		key key_any right_expr expr array numeric
+					ref computed operand left_operand
 
 %token	<hint>		HINT_P
 
 %left OR_P
 %left AND_P
 %right NOT_P
-%nonassoc IN_P IS_P
+%nonassoc IN_P IS_P LIKE_P
 %nonassoc '(' ')'
+/* "#-1" and "#1:-1" are array indexes, not subtractions */
+%nonassoc '#'
+%left '+' '-'
+%left '*' '/'
 
 /* Grammar follows */
 %%
@@ -274,6 +426,7 @@ scalar_value:
 	| OR_P							{ $$ = makeItemString(&$1); }
 	| AND_P							{ $$ = makeItemString(&$1); }
 	| NOT_P							{ $$ = makeItemString(&$1); }
+	| LIKE_P						{ $$ = makeItemString(&$1); }
 	| NULL_P						{ $$ = makeItemString(NULL); }
 	| TRUE_P						{ $$ = makeItemBool(true); }
 	| ARRAY_T						{ $$ = makeItemString(&$1); }
@@ -284,6 +437,14 @@ scalar_value:
 	| BOOLEAN_T						{ $$ = makeItemString(&$1); }
 	| NUMERIC_P						{ $$ = makeItemNumeric(&$1); }
 	| INT_P							{ $$ = makeItemNumeric(&$1); }
+	| signed_number					{ $$ = makeItemNumeric(&$1); }
+	;
+
+signed_number:
+	'-' NUMERIC_P					{ $$ = makeSignedNumber('-', &$2); }
+	| '-' INT_P						{ $$ = makeSignedNumber('-', &$2); }
+	| '+' NUMERIC_P					{ $$ = makeSignedNumber('+', &$2); }
+	| '+' INT_P						{ $$ = makeSignedNumber('+', &$2); }
 	;
 
 value_list:
@@ -291,9 +452,52 @@ value_list:
 	| value_list ',' scalar_value	{ $$ = lappend($1, $3); }
 	;
 
+array_index:
+	INT_P							{ $$ = $1; }
+	| NUMERIC_P						{ $$ = $1; }
+	| signed_number					{ $$ = $1; }
+	;
+
 numeric:
 	NUMERIC_P						{ $$ = makeItemNumeric(&$1); }
 	| INT_P							{ $$ = makeItemNumeric(&$1); }
+	| signed_number					{ $$ = makeItemNumeric(&$1); }
+	;
+
+/*
+ * reference to the value where the expression is evaluated
+ */
+ref:
+	'$'								{ $$ = makeItemPath(lappend(NIL, makeItemType(jqiCurrent))); }
+	| '$' '.' path					{ $$ = makeItemPath(lcons(makeItemType(jqiCurrent), $3)); }
+	;
+
+computed:
+	ref								{ $$ = $1; }
+	| '(' operand ')'				{ $$ = $2; }
+	| operand '+' operand			{ $$ = makeItemArithmetic(jqiAdd, $1, $3); }
+	| operand '-' operand			{ $$ = makeItemArithmetic(jqiSub, $1, $3); }
+	| operand '*' operand			{ $$ = makeItemArithmetic(jqiMul, $1, $3); }
+	| operand '/' operand			{ $$ = makeItemArithmetic(jqiDiv, $1, $3); }
+	;
+
+operand:
+	numeric							{ $$ = $1; }
+	| computed						{ $$ = $1; }
+	;
+
+/*
+ * arithmetic expression starting from the path
+ */
+left_operand:
+	path '+' operand				{ $$ = makeItemArithmetic(jqiAdd, makeItemPath($1), $3); }
+	| path '-' operand				{ $$ = makeItemArithmetic(jqiSub, makeItemPath($1), $3); }
+	| path '*' operand				{ $$ = makeItemArithmetic(jqiMul, makeItemPath($1), $3); }
+	| path '/' operand				{ $$ = makeItemArithmetic(jqiDiv, makeItemPath($1), $3); }
+	| left_operand '+' operand		{ $$ = makeItemArithmetic(jqiAdd, $1, $3); }
+	| left_operand '-' operand		{ $$ = makeItemArithmetic(jqiSub, $1, $3); }
+	| left_operand '*' operand		{ $$ = makeItemArithmetic(jqiMul, $1, $3); }
+	| left_operand '/' operand		{ $$ = makeItemArithmetic(jqiDiv, $1, $3); }
 	;
 
 right_expr:
@@ -301,10 +505,11 @@ right_expr:
 	| IN_P '(' value_list ')'		{ $$ = makeItemUnary(jqiIn, makeItemArray($3)); }
 	| '=' array						{ $$ = makeItemUnary(jqiEqual, $2); }
 	| '=' '*'						{ $$ = makeItemUnary(jqiEqual, makeItemType(jqiAny)); }
-	| '<' numeric					{ $$ = makeItemUnary(jqiLess, $2); }
-	| '>' numeric					{ $$ = makeItemUnary(jqiGreater, $2); }
-	| '<' '=' numeric				{ $$ = makeItemUnary(jqiLessOrEqual, $3); }
-	| '>' '=' numeric				{ $$ = makeItemUnary(jqiGreaterOrEqual, $3); }
+	| '=' computed					{ $$ = makeItemUnary(jqiEqual, $2); }
+	| '<' operand					{ $$ = makeItemUnary(jqiLess, $2); }
+	| '>' operand					{ $$ = makeItemUnary(jqiGreater, $2); }
+	| '<' '=' operand				{ $$ = makeItemUnary(jqiLessOrEqual, $3); }
+	| '>' '=' operand				{ $$ = makeItemUnary(jqiGreaterOrEqual, $3); }
 	| '@' '>' array					{ $$ = makeItemUnary(jqiContains, $3); }
 	| '<' '@' array					{ $$ = makeItemUnary(jqiContained, $3); }
 	| '&' '&' array					{ $$ = makeItemUnary(jqiOverlap, $3); }
@@ -313,19 +518,26 @@ right_expr:
 	| IS_P OBJECT_T					{ $$ = makeItemIs(jbvObject); }
 	| IS_P STRING_T					{ $$ = makeItemIs(jbvString); }
 	| IS_P BOOLEAN_T				{ $$ = makeItemIs(jbvBool); }
+	| '~' STRING_P					{ $$ = makeItemUnary(jqiRegex, makeItemString(&$2)); }
+	| LIKE_P STRING_P				{ $$ = makeItemUnary(jqiLike, makeItemString(&$2)); }
+	| '@' '@' '@' STRING_P			{ $$ = makeItemFts(NULL, &$4); }
+	| '@' '@' '@' STRING_P STRING_P	{ $$ = makeItemFts(&$4, &$5); }
+	| '~' '=' STRING_P				{ $$ = makeItemUnary(jqiIEqual, makeItemString(&$3)); }
 	;
 
 expr:
 	path							{  $$ = makeItemList($1); }
-	| path right_expr				{ $$ = makeItemList(lappend($1, $2)); }
-	| path HINT_P right_expr		{ $3->hint = $2; $$ = makeItemList(lappend($1, $3)); }
+	| path right_expr				{ $$ = makeItemExpr($1, $2); }
+	| path HINT_P right_expr		{ $3->hint = $2; $$ = makeItemExpr($1, $3); }
+	| left_operand right_expr		{ $$ = makeItemList(lappend(lappend(NIL, $1), $2)); }
+	| left_operand HINT_P right_expr	{ $3->hint = $2; $$ = makeItemList(lappend(lappend(NIL, $1), $3)); }
 	| NOT_P expr					{ $$ = makeItemUnary(jqiNot, $2); }
 	/*
 	 * In next two lines NOT_P is a path actually, not a an
 	 * logical expression.
 	 */
-	| NOT_P HINT_P right_expr		{ $3->hint = $2; $$ = makeItemList(lappend(lappend(NIL, makeItemKey(&$1)), $3)); }
-	| NOT_P right_expr				{ $$ = makeItemList(lappend(lappend(NIL, makeItemKey(&$1)), $2)); }
+	| NOT_P HINT_P right_expr		{ $3->hint = $2; $$ = makeItemExpr(lappend(NIL, makeItemKey(&$1)), $3); }
+	| NOT_P right_expr				{ $$ = makeItemExpr(lappend(NIL, makeItemKey(&$1)), $2); }
 	| path '(' expr ')'				{ $$ = makeItemList(lappend($1, $3)); }
 	| '(' expr ')'					{ $$ = $2; }
 	| expr AND_P expr				{ $$ = makeItemBinary(jqiAnd, $1, $3); }
@@ -344,12 +556,15 @@ key:
 	| '%' ':'						{ $$ = makeItemType(jqiAllKey); }
 	| '$'							{ $$ = makeItemType(jqiCurrent); }
 	| '@' '#'						{ $$ = makeItemType(jqiLength); }
-	| '#' INT_P						{ $$ = makeIndexArray(&$2); }
+	| '#' array_index				{ $$ = makeIndexArray(&$2); }
+	| '#' array_index ':' array_index	{ $$ = makeSliceArray(&$2, &$4); }
+	| '#' array_index ':' %prec '#'	{ $$ = makeSliceArray(&$2, NULL); }
 	| STRING_P						{ $$ = makeItemKey(&$1); }
 	| IN_P							{ $$ = makeItemKey(&$1); }
 	| IS_P							{ $$ = makeItemKey(&$1); }
 	| OR_P							{ $$ = makeItemKey(&$1); }
 	| AND_P							{ $$ = makeItemKey(&$1); }
+	| LIKE_P						{ $$ = makeItemKey(&$1); }
 	| NULL_P						{ $$ = makeItemKey(&$1); }
 	| TRUE_P						{ $$ = makeItemKey(&$1); }
 	| ARRAY_T						{ $$ = makeItemKey(&$1); }
@@ -360,6 +575,7 @@ key:
 	| BOOLEAN_T						{ $$ = makeItemKey(&$1); }
 	| NUMERIC_P						{ $$ = makeItemKey(&$1); }
 	| INT_P							{ $$ = makeItemKey(&$1); }
+	| signed_number					{ $$ = makeItemKey(&$1); }
 	;
 
 /*
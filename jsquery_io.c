@@ -81,6 +81,11 @@ flattenJsQueryParseItem(StringInfo buf, JsQueryParseItem *item, bool onlyCurrent
 			break;
 		case jqiAnd:
 		case jqiOr:
+		case jqiAdd:
+		case jqiSub:
+		case jqiMul:
+		case jqiDiv:
+		case jqiFts:
 			{
 				int32	left, right;
 
@@ -106,6 +111,9 @@ flattenJsQueryParseItem(StringInfo buf, JsQueryParseItem *item, bool onlyCurrent
 		case jqiOverlap:
 		case jqiNot:
 		case jqiFilter:
+		case jqiRegex:
+		case jqiLike:
+		case jqiIEqual:
 			{
 				int32 arg;
 
@@ -116,6 +124,26 @@ flattenJsQueryParseItem(StringInfo buf, JsQueryParseItem *item, bool onlyCurrent
 				*(int32*)(buf->data + arg) = chld;
 			}
 			break;
+		case jqiPath:
+			{
+				int32 arg;
+
+				arg = buf->len;
+				appendBinaryStringInfo(buf, (char*)&arg /* fake value */, sizeof(arg));
+
+				/* referenced path starts from the scratch */
+				chld = flattenJsQueryParseItem(buf, item->arg, false);
+				*(int32*)(buf->data + arg) = chld;
+			}
+			break;
+		case jqiSliceArray:
+			appendBinaryStringInfo(buf, (char*)&item->slice.start,
+								   sizeof(item->slice.start));
+			appendBinaryStringInfo(buf, (char*)&item->slice.end,
+								   sizeof(item->slice.end));
+			if (onlyCurrentInPath)
+				elog(ERROR,"Array length should be last in path");
+			break;
 		case jqiIndexArray:
 			appendBinaryStringInfo(buf, (char*)&item->arrayIndex,
 								   sizeof(item->arrayIndex));
@@ -147,13 +175,15 @@ flattenJsQueryParseItem(StringInfo buf, JsQueryParseItem *item, bool onlyCurrent
 	return  pos;
 }
 
-PG_FUNCTION_INFO_V1(jsquery_in);
-Datum
-jsquery_in(PG_FUNCTION_ARGS)
+/*
+ * Parse jsquery text into binary representation.  Together with
+ * executeJsQuery() it allows other modules to filter jsonb by jsquery
+ * without going through fmgr.
+ */
+JsQuery *
+compileJsQuery(const char *str, int len)
 {
-	char				*in = PG_GETARG_CSTRING(0);
-	int32				len = strlen(in);
-	JsQueryParseItem	*jsquery = parsejsquery(in, len);
+	JsQueryParseItem	*jsquery = parsejsquery(str, len);
 	JsQuery				*res;
 	StringInfoData		buf;
 
@@ -167,7 +197,16 @@ jsquery_in(PG_FUNCTION_ARGS)
 	res = (JsQuery*)buf.data;
 	SET_VARSIZE(res, buf.len);
 
-	PG_RETURN_JSQUERY(res);
+	return res;
+}
+
+PG_FUNCTION_INFO_V1(jsquery_in);
+Datum
+jsquery_in(PG_FUNCTION_ARGS)
+{
+	char				*in = PG_GETARG_CSTRING(0);
+
+	PG_RETURN_JSQUERY(compileJsQuery(in, strlen(in)));
 }
 
 static void
@@ -213,16 +252,65 @@ printOperation(StringInfo buf, JsQueryItemType type)
 			appendBinaryStringInfo(buf, " <@ ", 4); break;
 		case jqiOverlap:
 			appendBinaryStringInfo(buf, " && ", 4); break;
+		case jqiRegex:
+			appendBinaryStringInfo(buf, " ~ ", 3); break;
+		case jqiLike:
+			appendBinaryStringInfo(buf, " LIKE ", 6); break;
+		case jqiFts:
+			appendBinaryStringInfo(buf, " @@@ ", 5); break;
+		case jqiIEqual:
+			appendBinaryStringInfo(buf, " ~= ", 4); break;
+		case jqiAdd:
+			appendBinaryStringInfo(buf, " + ", 3); break;
+		case jqiSub:
+			appendBinaryStringInfo(buf, " - ", 3); break;
+		case jqiMul:
+			appendBinaryStringInfo(buf, " * ", 3); break;
+		case jqiDiv:
+			appendBinaryStringInfo(buf, " / ", 3); break;
 		default:
 			elog(ERROR, "Unknown type: %d", type);
 	}
 }
 
+#define isArithmetic(type) \
+	((type) == jqiAdd || (type) == jqiSub || (type) == jqiMul || (type) == jqiDiv)
+
+static void printJsQueryItem(StringInfo buf, JsQueryItem *v, bool inKey,
+							 bool printBracketes);
+
+/*
+ * Print operand of arithmetic operation, parenthesize it if it binds weaker
+ * than operation (or the same for right operand, since they're left
+ * associative).
+ */
+static void
+printArithmeticArg(StringInfo buf, JsQueryItem *v, JsQueryItemType parent,
+				   bool right)
+{
+	bool	parens = false;
+
+	if (isArithmetic(v->type))
+	{
+		bool	weak = (v->type == jqiAdd || v->type == jqiSub),
+				parentWeak = (parent == jqiAdd || parent == jqiSub);
+
+		parens = (weak && !parentWeak) || (right && weak == parentWeak);
+	}
+
+	if (parens)
+		appendStringInfoChar(buf, '(');
+	printJsQueryItem(buf, v, false, true);
+	if (parens)
+		appendStringInfoChar(buf, ')');
+}
+
 static void
 printJsQueryItem(StringInfo buf, JsQueryItem *v, bool inKey, bool printBracketes)
 {
 	JsQueryItem	elem;
 	bool		first = true;
+	bool		parens = false;
 
 	check_stack_depth();
 
@@ -310,16 +398,54 @@ printJsQueryItem(StringInfo buf, JsQueryItem *v, bool inKey, bool printBracketes
 		case jqiContains:
 		case jqiContained:
 		case jqiOverlap:
+		case jqiRegex:
+		case jqiLike:
+		case jqiIEqual:
 			printOperation(buf, v->type);
 			jsqGetArg(v, &elem);
 			printJsQueryItem(buf, &elem, false, true);
 			break;
+		case jqiFts:
+			/* text search configuration goes before the query */
+			printOperation(buf, v->type);
+			jsqGetLeftArg(v, &elem);
+			printJsQueryItem(buf, &elem, false, true);
+			appendStringInfoChar(buf, ' ');
+			jsqGetRightArg(v, &elem);
+			printJsQueryItem(buf, &elem, false, true);
+			break;
 		case jqiIn:
 			appendBinaryStringInfo(buf, " IN (", 5);
 			jsqGetArg(v, &elem);
 			printJsQueryItem(buf, &elem, false, false);
 			appendStringInfoChar(buf, ')');
 			break;
+		case jqiPath:
+		case jqiAdd:
+		case jqiSub:
+		case jqiMul:
+		case jqiDiv:
+			/* expression nested into path is parenthesized as a whole */
+			if (inKey && jsqGetNext(v, NULL))
+			{
+				parens = true;
+				appendStringInfoChar(buf, '(');
+			}
+
+			if (v->type == jqiPath)
+			{
+				jsqGetArg(v, &elem);
+				printJsQueryItem(buf, &elem, false, true);
+			}
+			else
+			{
+				jsqGetLeftArg(v, &elem);
+				printArithmeticArg(buf, &elem, v->type, false);
+				printOperation(buf, v->type);
+				jsqGetRightArg(v, &elem);
+				printArithmeticArg(buf, &elem, v->type, true);
+			}
+			break;
 		case jqiNot:
 			appendStringInfoChar(buf, '(');
 			appendBinaryStringInfo(buf, "NOT ", 4);
@@ -374,7 +500,14 @@ printJsQueryItem(StringInfo buf, JsQueryItem *v, bool inKey, bool printBracketes
 		case jqiIndexArray:
 			if (inKey)
 				appendStringInfoChar(buf, '.');
-			appendStringInfo(buf, "#%u", v->arrayIndex);
+			appendStringInfo(buf, "#%d", v->arrayIndex);
+			break;
+		case jqiSliceArray:
+			if (inKey)
+				appendStringInfoChar(buf, '.');
+			appendStringInfo(buf, "#%d:", v->slice.start);
+			if (v->slice.end != JSQ_SLICE_END)
+				appendStringInfo(buf, "%d", v->slice.end);
 			break;
 		case jqiFilter:
 			if (inKey)
@@ -390,6 +523,9 @@ printJsQueryItem(StringInfo buf, JsQueryItem *v, bool inKey, bool printBracketes
 
 	if (jsqGetNext(v, &elem))
 		printJsQueryItem(buf, &elem, true, true);
+
+	if (parens)
+		appendStringInfoChar(buf, ')');
 }
 
 PG_FUNCTION_INFO_V1(jsquery_out);
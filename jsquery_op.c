@@ -15,8 +15,18 @@
 
 #include "postgres.h"
 
+#include "catalog/pg_collation.h"
+#include "catalog/pg_type.h"
+#include "funcapi.h"
 #include "miscadmin.h"
+#if PG_VERSION_NUM >= 120000
+#include "regex/regex.h"
+#endif
+#include "tsearch/ts_type.h"
+#include "tsearch/ts_utils.h"
+#include "utils/array.h"
 #include "utils/builtins.h"
+#include "utils/formatting.h"
 #include "utils/pg_crc.h"
 #if PG_VERSION_NUM >= 90500
 /*
@@ -30,26 +40,105 @@
 
 #include "jsquery.h"
 
+typedef struct PathElem {
+	char		*key;		/* NULL for array element */
+	int			keylen;
+	int32		index;
+} PathElem;
+
 typedef struct ResultAccum {
 	StringInfo	buf;
 	bool		missAppend;
 	JsonbParseState	*jbArrayState;
+	bool		collectPaths;	/* append paths of values instead of values */
+	bool		collectValues;	/* accumulate values into list */
+	List		*values;
+	PathElem	*path;			/* path of current value */
+	int			pathLen;
+	int			pathSize;
 } ResultAccum;
 
 
 static bool recursiveExecute(JsQueryItem *jsq, JsonbValue *jb, JsQueryItem *jsqLeftArg,
 							 ResultAccum *ra);
 
+static void
+pushPath(ResultAccum *ra, char *key, int keylen, int32 index)
+{
+	PathElem	*elem;
+
+	if (ra == NULL || ra->collectPaths == false)
+		return;
+
+	if (ra->pathLen >= ra->pathSize)
+	{
+		ra->pathSize = (ra->pathSize > 0) ? 2 * ra->pathSize : 8;
+		if (ra->path)
+			ra->path = repalloc(ra->path, sizeof(PathElem) * ra->pathSize);
+		else
+			ra->path = palloc(sizeof(PathElem) * ra->pathSize);
+	}
+
+	elem = &ra->path[ra->pathLen++];
+	elem->key = key;
+	elem->keylen = keylen;
+	elem->index = index;
+}
+
+static void
+popPath(ResultAccum *ra)
+{
+	if (ra == NULL || ra->collectPaths == false)
+		return;
+
+	Assert(ra->pathLen > 0);
+	ra->pathLen--;
+}
+
 static void
 appendResult(ResultAccum *ra, JsonbValue *jb)
 {
 	if (ra == NULL || ra->missAppend == true)
 		return;
 
+	if (ra->collectValues)
+	{
+		JsonbValue	*v = palloc(sizeof(*v));
+
+		*v = *jb;
+		ra->values = lappend(ra->values, v);
+		return;
+	}
+
 	if (ra->jbArrayState == NULL)
 		pushJsonbValue(&ra->jbArrayState, WJB_BEGIN_ARRAY, NULL);
 
-	pushJsonbValue(&ra->jbArrayState, WJB_ELEM, jb);
+	if (ra->collectPaths)
+	{
+		JsonbValue	v;
+		int			i;
+
+		/* path is appended as array of keys and array indexes */
+		pushJsonbValue(&ra->jbArrayState, WJB_BEGIN_ARRAY, NULL);
+		for (i = 0; i < ra->pathLen; i++)
+		{
+			v.type = jbvString;
+			if (ra->path[i].key)
+			{
+				v.val.string.val = ra->path[i].key;
+				v.val.string.len = ra->path[i].keylen;
+			}
+			else
+			{
+				v.val.string.val = psprintf("%d", ra->path[i].index);
+				v.val.string.len = strlen(v.val.string.val);
+			}
+			pushJsonbValue(&ra->jbArrayState, WJB_ELEM, &v);
+		}
+		pushJsonbValue(&ra->jbArrayState, WJB_END_ARRAY, NULL);
+	}
+	else
+		pushJsonbValue(&ra->jbArrayState, WJB_ELEM, jb);
 }
 
 static void
@@ -108,6 +197,20 @@ JsonbType(JsonbValue *jb)
 	return type;
 }
 
+#define JsonbArraySize(jbc)	((int32) ((jbc)->header & JB_CMASK))
+
+/*
+ * Convert index of array element, negative index counts from the end of
+ * array.  Result is negative if there is no such element.
+ */
+static int32
+getArrayIndex(JsonbContainer *jbc, int32 index)
+{
+	if (index < 0)
+		index += JsonbArraySize(jbc);
+	return index;
+}
+
 static bool
 recursiveAny(JsQueryItem *jsq, JsonbValue *jb, ResultAccum *ra)
 {
@@ -115,6 +218,8 @@ recursiveAny(JsQueryItem *jsq, JsonbValue *jb, ResultAccum *ra)
 	JsonbIterator	*it;
 	int32			r;
 	JsonbValue		v;
+	JsonbValue		k;
+	int32			i = 0;
 
 	check_stack_depth();
 
@@ -124,9 +229,13 @@ recursiveAny(JsQueryItem *jsq, JsonbValue *jb, ResultAccum *ra)
 	{
 		if (r == WJB_KEY)
 		{
+			k = v;
 			r = JsonbIteratorNext(&it, &v, true);
 			Assert(r == WJB_VALUE);
+			pushPath(ra, k.val.string.val, k.val.string.len, 0);
 		}
+		else if (r == WJB_ELEM)
+			pushPath(ra, NULL, 0, i++);
 
 		if (r == WJB_VALUE || r == WJB_ELEM)
 		{
@@ -138,6 +247,8 @@ recursiveAny(JsQueryItem *jsq, JsonbValue *jb, ResultAccum *ra)
 
 			if (res == false && v.type == jbvBinary)
 				res = recursiveAny(jsq, &v, ra);
+
+			popPath(ra);
 		}
 	}
 
@@ -151,6 +262,8 @@ recursiveAll(JsQueryItem *jsq, JsonbValue *jb, ResultAccum *ra)
 	JsonbIterator	*it;
 	int32			r;
 	JsonbValue		v;
+	JsonbValue		k;
+	int32			i = 0;
 
 	check_stack_depth();
 
@@ -160,9 +273,13 @@ recursiveAll(JsQueryItem *jsq, JsonbValue *jb, ResultAccum *ra)
 	{
 		if (r == WJB_KEY)
 		{
+			k = v;
 			r = JsonbIteratorNext(&it, &v, true);
 			Assert(r == WJB_VALUE);
+			pushPath(ra, k.val.string.val, k.val.string.len, 0);
 		}
+		else if (r == WJB_ELEM)
+			pushPath(ra, NULL, 0, i++);
 
 		if (r == WJB_VALUE || r == WJB_ELEM)
 		{
@@ -176,6 +293,8 @@ recursiveAll(JsQueryItem *jsq, JsonbValue *jb, ResultAccum *ra)
 					res = recursiveAll(jsq, &v, ra);
 			}
 
+			popPath(ra);
+
 			if (res == false)
 				break;
 		}
@@ -366,6 +485,105 @@ makeCompare(JsQueryItem *jsq, int32 op, JsonbValue *jb)
 	return false;
 }
 
+/*
+ * Match string value against full text search query.  Both the value and the
+ * query are parsed with text search configuration given in the item.
+ */
+static bool
+checkFtsMatch(JsQueryItem *jsq, JsonbValue *jb)
+{
+	JsQueryItem		config,
+					pattern;
+	Oid				cfgId;
+	char		   *s;
+	int32			len;
+
+	if (jb->type != jbvString)
+		return false;
+
+	jsqGetLeftArg(jsq, &config);
+	jsqGetRightArg(jsq, &pattern);
+	cfgId = jsqGetTSConfig(&config);
+	s = jsqGetString(&pattern, &len);
+
+	return DatumGetBool(DirectFunctionCall2(ts_match_vq,
+				DirectFunctionCall2(to_tsvector_byid,
+					ObjectIdGetDatum(cfgId),
+					PointerGetDatum(cstring_to_text_with_len(jb->val.string.val,
+															 jb->val.string.len))),
+				DirectFunctionCall2(to_tsquery_byid,
+					ObjectIdGetDatum(cfgId),
+					PointerGetDatum(cstring_to_text_with_len(s, len)))));
+}
+
+/*
+ * Match string value against regular expression (ARE syntax) or LIKE pattern,
+ * or compare it with string ignoring case.  Non-string values never match.
+ */
+static bool
+checkScalarMatch(JsQueryItem *jsq, int32 op, JsonbValue *jb)
+{
+	text	*pattern;
+	char	*s;
+	int32	len;
+	bool	res;
+
+	if (jb->type != jbvString)
+		return false;
+	if (jsq->type != jqiString)
+		return false;
+
+	s = jsqGetString(jsq, &len);
+
+	switch(op)
+	{
+		case jqiRegex:
+			pattern = cstring_to_text_with_len(s, len);
+#if PG_VERSION_NUM >= 120000
+			res = RE_compile_and_execute(pattern,
+										 jb->val.string.val,
+										 jb->val.string.len,
+										 REG_ADVANCED,
+										 DEFAULT_COLLATION_OID,
+										 0, NULL);
+#else
+			res = DatumGetBool(DirectFunctionCall2Coll(textregexeq,
+						DEFAULT_COLLATION_OID,
+						PointerGetDatum(cstring_to_text_with_len(jb->val.string.val,
+																 jb->val.string.len)),
+						PointerGetDatum(pattern)));
+#endif
+			pfree(pattern);
+			break;
+		case jqiLike:
+			pattern = cstring_to_text_with_len(s, len);
+			res = DatumGetBool(DirectFunctionCall2Coll(textlike,
+						DEFAULT_COLLATION_OID,
+						PointerGetDatum(cstring_to_text_with_len(jb->val.string.val,
+																 jb->val.string.len)),
+						PointerGetDatum(pattern)));
+			pfree(pattern);
+			break;
+		case jqiIEqual:
+			{
+				char   *s1 = str_tolower(s, len, DEFAULT_COLLATION_OID),
+					   *s2 = str_tolower(jb->val.string.val,
+										 jb->val.string.len,
+										 DEFAULT_COLLATION_OID);
+
+				res = (strcmp(s1, s2) == 0);
+				pfree(s1);
+				pfree(s2);
+			}
+			break;
+		default:
+			elog(ERROR, "Unknown operation");
+			res = false; /* keep compiler quiet */
+	}
+
+	return res;
+}
+
 static bool
 executeExpr(JsQueryItem *jsq, int32 op, JsonbValue *jb, JsQueryItem *jsqLeftArg)
 {
@@ -410,6 +628,9 @@ executeExpr(JsQueryItem *jsq, int32 op, JsonbValue *jb, JsQueryItem *jsqLeftArg)
 				case jqiOverlap:
 				case jqiContains:
 				case jqiContained:
+				case jqiRegex:
+				case jqiLike:
+				case jqiIEqual:
 					break;
 				default:
 					elog(ERROR, "Unknown operation");
@@ -440,6 +661,11 @@ executeExpr(JsQueryItem *jsq, int32 op, JsonbValue *jb, JsQueryItem *jsqLeftArg)
 			case jqiGreaterOrEqual:
 				res = makeCompare(jsq, op, jb);
 				break;
+			case jqiRegex:
+			case jqiLike:
+			case jqiIEqual:
+				res = checkScalarMatch(jsq, op, jb);
+				break;
 			default:
 				elog(ERROR, "Unknown operation");
 		}
@@ -448,6 +674,247 @@ executeExpr(JsQueryItem *jsq, int32 op, JsonbValue *jb, JsQueryItem *jsqLeftArg)
 	return res;
 }
 
+/*
+ * Evaluate operand of expression: constant, path referring to the value where
+ * expression is evaluated or arithmetic operation over them.  Path may select
+ * several values, so list of values is returned.  Arithmetic skips non-numeric
+ * values and division by zero, like comparison of mismatching types doesn't
+ * match.
+ */
+static List *
+evaluateOperand(JsQueryItem *jsq, JsonbValue *jb)
+{
+	JsQueryItem		elem;
+	JsonbValue		*v;
+	List			*res = NIL;
+
+	check_stack_depth();
+
+	switch(jsq->type)
+	{
+		case jqiNull:
+		case jqiString:
+		case jqiNumeric:
+		case jqiBool:
+			v = palloc(sizeof(*v));
+			v->type = (enum jbvType) jsq->type; /* see enums */
+			if (jsq->type == jqiString)
+				v->val.string.val = jsqGetString(jsq, &v->val.string.len);
+			else if (jsq->type == jqiNumeric)
+				v->val.numeric = jsqGetNumeric(jsq);
+			else if (jsq->type == jqiBool)
+				v->val.boolean = jsqGetBool(jsq);
+			res = lappend(res, v);
+			break;
+		case jqiPath:
+			{
+				ResultAccum		ra;
+				ListCell		*cell;
+
+				memset(&ra, 0, sizeof(ra));
+				ra.collectValues = true;
+
+				jsqGetArg(jsq, &elem);
+				recursiveExecute(&elem, jb, NULL, &ra);
+
+				foreach(cell, ra.values)
+				{
+					v = (JsonbValue *) lfirst(cell);
+
+					/* raw scalar is compared as scalar */
+					if (JsonbType(v) == jbvScalar)
+					{
+						JsonbIterator	*it;
+						int32			r PG_USED_FOR_ASSERTS_ONLY;
+						JsonbValue		tmp;
+
+						it = JsonbIteratorInit(v->val.binary.data);
+
+						r = JsonbIteratorNext(&it, &tmp, true);
+						Assert(r == WJB_BEGIN_ARRAY);
+						r = JsonbIteratorNext(&it, &tmp, true);
+						Assert(r == WJB_ELEM);
+
+						*v = tmp;
+					}
+				}
+
+				res = ra.values;
+			}
+			break;
+		case jqiAdd:
+		case jqiSub:
+		case jqiMul:
+		case jqiDiv:
+			{
+				List		*left, *right;
+				ListCell	*lcell, *rcell;
+				PGFunction	func;
+				Numeric		zero = NULL;
+
+				jsqGetLeftArg(jsq, &elem);
+				left = evaluateOperand(&elem, jb);
+				if (left == NIL)
+					break;
+
+				jsqGetRightArg(jsq, &elem);
+				right = evaluateOperand(&elem, jb);
+
+				switch(jsq->type)
+				{
+					case jqiAdd:
+						func = numeric_add;
+						break;
+					case jqiSub:
+						func = numeric_sub;
+						break;
+					case jqiMul:
+						func = numeric_mul;
+						break;
+					default:
+						func = numeric_div;
+						zero = DatumGetNumeric(DirectFunctionCall1(int4_numeric,
+														Int32GetDatum(0)));
+						break;
+				}
+
+				foreach(lcell, left)
+				{
+					JsonbValue	*l = (JsonbValue *) lfirst(lcell);
+
+					if (l->type != jbvNumeric)
+						continue;
+
+					foreach(rcell, right)
+					{
+						JsonbValue	*r = (JsonbValue *) lfirst(rcell);
+
+						if (r->type != jbvNumeric)
+							continue;
+						if (zero && compareNumeric(r->val.numeric, zero) == 0)
+							continue;
+
+						v = palloc(sizeof(*v));
+						v->type = jbvNumeric;
+						v->val.numeric = DatumGetNumeric(DirectFunctionCall2(func,
+											NumericGetDatum(l->val.numeric),
+											NumericGetDatum(r->val.numeric)));
+						res = lappend(res, v);
+					}
+				}
+			}
+			break;
+		default:
+			elog(ERROR, "Wrong state: %d", jsq->type);
+	}
+
+	return res;
+}
+
+static bool
+compareOperands(int32 op, JsonbValue *l, JsonbValue *r)
+{
+	int		res;
+
+	if (op == jqiEqual)
+	{
+		if (l->type != r->type)
+			return false;
+
+		switch(l->type)
+		{
+			case jbvNull:
+				return true;
+			case jbvString:
+				return (l->val.string.len == r->val.string.len &&
+						memcmp(l->val.string.val, r->val.string.val,
+							   l->val.string.len) == 0);
+			case jbvBool:
+				return (l->val.boolean == r->val.boolean);
+			case jbvNumeric:
+				return (compareNumeric(l->val.numeric, r->val.numeric) == 0);
+			default:
+				/* arrays and objects are not compared */
+				return false;
+		}
+	}
+
+	if (l->type != jbvNumeric || r->type != jbvNumeric)
+		return false;
+
+	res = compareNumeric(l->val.numeric, r->val.numeric);
+
+	switch(op)
+	{
+		case jqiLess:
+			return (res < 0);
+		case jqiGreater:
+			return (res > 0);
+		case jqiLessOrEqual:
+			return (res <= 0);
+		case jqiGreaterOrEqual:
+			return (res >= 0);
+		default:
+			elog(ERROR, "Unknown operation");
+	}
+
+	return false;
+}
+
+/*
+ * Execute expression with computed left operand, it's followed by operation.
+ * Both operands are evaluated against the same value, so comparison between
+ * different parts of document needs only a single pass over them.
+ */
+static bool
+executeComputedExpr(JsQueryItem *jsq, JsonbValue *jb)
+{
+	JsQueryItem		op, arg;
+	List			*left, *right = NIL;
+	ListCell		*lcell, *rcell;
+	bool			computedArg = false;
+
+	if (jsqGetNext(jsq, &op) == false)
+		elog(ERROR, "Wrong state: computed operand without operation");
+
+	left = evaluateOperand(jsq, jb);
+	if (left == NIL)
+		return false;
+
+	if (op.type != jqiIs)
+	{
+		jsqGetArg(&op, &arg);
+		computedArg = (arg.type == jqiPath || arg.type == jqiAdd ||
+					   arg.type == jqiSub || arg.type == jqiMul ||
+					   arg.type == jqiDiv);
+		if (computedArg)
+			right = evaluateOperand(&arg, jb);
+	}
+
+	foreach(lcell, left)
+	{
+		JsonbValue	*l = (JsonbValue *) lfirst(lcell);
+
+		if (op.type == jqiIs)
+		{
+			if (jsqGetIsType(&op) == JsonbType(l))
+				return true;
+		}
+		else if (computedArg)
+		{
+			foreach(rcell, right)
+				if (compareOperands(op.type, l, (JsonbValue *) lfirst(rcell)))
+					return true;
+		}
+		else if (executeExpr(&arg, op.type, l, NULL))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
 static bool
 recursiveExecute(JsQueryItem *jsq, JsonbValue *jb, JsQueryItem *jsqLeftArg,
 				 ResultAccum *ra)
@@ -523,6 +990,7 @@ recursiveExecute(JsQueryItem *jsq, JsonbValue *jb, JsQueryItem *jsqLeftArg,
 
 				if (v != NULL)
 				{
+					pushPath(ra, key.val.string.val, key.val.string.len, 0);
 					if (jsqGetNext(jsq, &elem) == false)
 					{
 						appendResult(ra, v);
@@ -530,6 +998,7 @@ recursiveExecute(JsQueryItem *jsq, JsonbValue *jb, JsQueryItem *jsqLeftArg,
 					}
 					else
 						res = recursiveExecute(&elem, v, NULL, ra);
+					popPath(ra);
 					pfree(v);
 				}
 			}
@@ -595,6 +1064,7 @@ recursiveExecute(JsQueryItem *jsq, JsonbValue *jb, JsQueryItem *jsqLeftArg,
 				JsonbValue		v;
 				bool			anyres = false;
 				bool			hasNext;
+				int32			i = 0;
 
 				hasNext = jsqGetNext(jsq, &elem);
 				it = JsonbIteratorInit(jb->val.binary.data);
@@ -604,8 +1074,14 @@ recursiveExecute(JsQueryItem *jsq, JsonbValue *jb, JsQueryItem *jsqLeftArg,
 					res = true;
 
 					while(ra && (r = JsonbIteratorNext(&it, &v, true)) != WJB_DONE)
+					{
 						if (r == WJB_ELEM)
+						{
+							pushPath(ra, NULL, 0, i++);
 							appendResult(ra, &v);
+							popPath(ra);
+						}
+					}
 
 					break;
 				}
@@ -617,7 +1093,9 @@ recursiveExecute(JsQueryItem *jsq, JsonbValue *jb, JsQueryItem *jsqLeftArg,
 				{
 					if (r == WJB_ELEM)
 					{
+						pushPath(ra, NULL, 0, i++);
 						res = recursiveExecute(&elem, &v, NULL, ra);
+						popPath(ra);
 
 						if (jsq->type == jqiAnyArray)
 						{
@@ -641,13 +1119,17 @@ recursiveExecute(JsQueryItem *jsq, JsonbValue *jb, JsQueryItem *jsqLeftArg,
 		case jqiIndexArray:
 			if (JsonbType(jb) == jbvArray)
 			{
-				JsonbValue		*v;
+				JsonbValue		*v = NULL;
+				int32			index;
 
-				v = getIthJsonbValueFromContainer(jb->val.binary.data,
-												  jsq->arrayIndex);
+				index = getArrayIndex(jb->val.binary.data, jsq->arrayIndex);
+				if (index >= 0)
+					v = getIthJsonbValueFromContainer(jb->val.binary.data,
+													  index);
 
 				if (v)
 				{
+					pushPath(ra, NULL, 0, index);
 					if (jsqGetNext(jsq, &elem) == false)
 					{
 						res = true;
@@ -655,6 +1137,44 @@ recursiveExecute(JsQueryItem *jsq, JsonbValue *jb, JsQueryItem *jsqLeftArg,
 					}
 					else
 						res = recursiveExecute(&elem, v, NULL, ra);
+					popPath(ra);
+				}
+			}
+			break;
+		case jqiSliceArray:
+			if (JsonbType(jb) == jbvArray)
+			{
+				JsonbContainer	*jbc = jb->val.binary.data;
+				int32			start = getArrayIndex(jbc, jsq->slice.start),
+								end = getArrayIndex(jbc, jsq->slice.end),
+								i;
+				bool			hasNext;
+
+				/* out of range bounds are clamped */
+				start = Max(start, 0);
+				end = Min(end, JsonbArraySize(jbc));
+
+				hasNext = jsqGetNext(jsq, &elem);
+
+				/* only elements of the slice are accessed */
+				for (i = start; i < end; i++)
+				{
+					JsonbValue	*v = getIthJsonbValueFromContainer(jbc, i);
+
+					pushPath(ra, NULL, 0, i);
+					if (hasNext == false)
+					{
+						res = true;
+						appendResult(ra, v);
+					}
+					else if (recursiveExecute(&elem, v, NULL, ra))
+						res = true;
+					popPath(ra);
+
+					pfree(v);
+
+					if (res == true && (ra == NULL || ra->missAppend == true))
+						break;
 				}
 			}
 			break;
@@ -665,6 +1185,7 @@ recursiveExecute(JsQueryItem *jsq, JsonbValue *jb, JsQueryItem *jsqLeftArg,
 				JsonbIterator	*it;
 				int32			r;
 				JsonbValue		v;
+				JsonbValue		k;
 				bool			anyres = false;
 				bool			hasNext;
 
@@ -676,8 +1197,16 @@ recursiveExecute(JsQueryItem *jsq, JsonbValue *jb, JsQueryItem *jsqLeftArg,
 					res = true;
 
 					while(ra && (r = JsonbIteratorNext(&it, &v, true)) != WJB_DONE)
-						if (r == WJB_VALUE)
+					{
+						if (r == WJB_KEY)
+							k = v;
+						else if (r == WJB_VALUE)
+						{
+							pushPath(ra, k.val.string.val, k.val.string.len, 0);
 							appendResult(ra, &v);
+							popPath(ra);
+						}
+					}
 
 					break;
 				}
@@ -687,9 +1216,13 @@ recursiveExecute(JsQueryItem *jsq, JsonbValue *jb, JsQueryItem *jsqLeftArg,
 
 				while((r = JsonbIteratorNext(&it, &v, true)) != WJB_DONE)
 				{
-					if (r == WJB_VALUE)
+					if (r == WJB_KEY)
+						k = v;
+					else if (r == WJB_VALUE)
 					{
+						pushPath(ra, k.val.string.val, k.val.string.len, 0);
 						res = recursiveExecute(&elem, &v, NULL, ra);
+						popPath(ra);
 
 						if (jsq->type == jqiAnyKey)
 						{
@@ -719,12 +1252,42 @@ recursiveExecute(JsQueryItem *jsq, JsonbValue *jb, JsQueryItem *jsqLeftArg,
 		case jqiContains:
 		case jqiContained:
 		case jqiOverlap:
+		case jqiRegex:
+		case jqiLike:
+		case jqiIEqual:
 			jsqGetArg(jsq, &elem);
 			res = executeExpr(&elem, jsq->type, jb, jsqLeftArg);
 			break;
+		case jqiFts:
+			/* length is never a string */
+			if (!(jsqLeftArg && jsqLeftArg->type == jqiLength))
+				res = checkFtsMatch(jsq, jb);
+			break;
 		case jqiLength:
-			jsqGetNext(jsq, &elem);
-			res = recursiveExecute(&elem, jb, jsq, ra);
+			if (jsqGetNext(jsq, &elem) == false)
+			{
+				/* length is a value selected by path */
+				if (JsonbType(jb) == jbvArray || JsonbType(jb) == jbvObject)
+				{
+					JsonbValue	v;
+
+					/* count of elements or pairs */
+					v.type = jbvNumeric;
+					v.val.numeric = DatumGetNumeric(DirectFunctionCall1(int4_numeric,
+										Int32GetDatum(JsonbArraySize(jb->val.binary.data))));
+					appendResult(ra, &v);
+					res = true;
+				}
+			}
+			else
+				res = recursiveExecute(&elem, jb, jsq, ra);
+			break;
+		case jqiPath:
+		case jqiAdd:
+		case jqiSub:
+		case jqiMul:
+		case jqiDiv:
+			res = executeComputedExpr(jsq, jb);
 			break;
 		case jqiIs:
 			if (JsonbType(jb) == jbvScalar)
@@ -778,13 +1341,12 @@ recursiveExecute(JsQueryItem *jsq, JsonbValue *jb, JsQueryItem *jsqLeftArg,
 	return res;
 }
 
-PG_FUNCTION_INFO_V1(jsquery_json_exec);
-Datum
-jsquery_json_exec(PG_FUNCTION_ARGS)
+/*
+ * Check if jsonb document matches jsquery.
+ */
+bool
+executeJsQuery(JsQuery *jq, Jsonb *jb)
 {
-	JsQuery			*jq = PG_GETARG_JSQUERY(0);
-	Jsonb			*jb = PG_GETARG_JSONB_P(1);
-	bool			res;
 	JsonbValue		jbv;
 	JsQueryItem		jsq;
 
@@ -794,7 +1356,18 @@ jsquery_json_exec(PG_FUNCTION_ARGS)
 
 	jsqInit(&jsq, jq);
 
-	res = recursiveExecute(&jsq, &jbv, NULL, NULL);
+	return recursiveExecute(&jsq, &jbv, NULL, NULL);
+}
+
+PG_FUNCTION_INFO_V1(jsquery_json_exec);
+Datum
+jsquery_json_exec(PG_FUNCTION_ARGS)
+{
+	JsQuery			*jq = PG_GETARG_JSQUERY(0);
+	Jsonb			*jb = PG_GETARG_JSONB_P(1);
+	bool			res;
+
+	res = executeJsQuery(jq, jb);
 
 	PG_FREE_IF_COPY(jq, 0);
 	PG_FREE_IF_COPY(jb, 1);
@@ -809,16 +1382,8 @@ json_jsquery_exec(PG_FUNCTION_ARGS)
 	Jsonb			*jb = PG_GETARG_JSONB_P(0);
 	JsQuery			*jq = PG_GETARG_JSQUERY(1);
 	bool			res;
-	JsonbValue		jbv;
-	JsQueryItem	jsq;
 
-	jbv.type = jbvBinary;
-	jbv.val.binary.data = &jb->root;
-	jbv.val.binary.len = VARSIZE_ANY_EXHDR(jb);
-
-	jsqInit(&jsq, jq);
-
-	res = recursiveExecute(&jsq, &jbv, NULL, NULL);
+	res = executeJsQuery(jq, jb);
 
 	PG_FREE_IF_COPY(jb, 0);
 	PG_FREE_IF_COPY(jq, 1);
@@ -862,6 +1427,546 @@ json_jsquery_filter(PG_FUNCTION_ARGS)
 	PG_RETURN_NULL();
 }
 
+/*
+ * Execute jsquery collecting paths of values which would be returned by ~~
+ * operator.  Returns list of arrays (jbvArray) of object keys and array
+ * indexes as strings.
+ */
+static List *
+collectMatchedPaths(Jsonb *jb, JsQuery *jq)
+{
+	JsonbValue		jbv;
+	JsQueryItem		jsq;
+	ResultAccum		ra;
+	Jsonb			*res;
+	JsonbIterator	*it;
+	JsonbValue		v;
+	int32			r;
+	JsonbValue		*path = NULL;
+	List			*paths = NIL;
+
+	jbv.type = jbvBinary;
+	jbv.val.binary.data = &jb->root;
+	jbv.val.binary.len = VARSIZE_ANY_EXHDR(jb);
+
+	jsqInit(&jsq, jq);
+	memset(&ra, 0, sizeof(ra));
+	ra.collectPaths = true;
+
+	recursiveExecute(&jsq, &jbv, NULL, &ra);
+
+	if (ra.jbArrayState == NULL)
+		return NIL;
+
+	res = JsonbValueToJsonb(
+			pushJsonbValue(&ra.jbArrayState, WJB_END_ARRAY, NULL)
+	);
+
+	it = JsonbIteratorInit(&res->root);
+	r = JsonbIteratorNext(&it, &v, false);
+	Assert(r == WJB_BEGIN_ARRAY);
+
+	while((r = JsonbIteratorNext(&it, &v, false)) != WJB_DONE)
+	{
+		if (r == WJB_BEGIN_ARRAY)
+		{
+			path = palloc(sizeof(JsonbValue));
+			path->type = jbvArray;
+			path->val.array.rawScalar = false;
+			path->val.array.nElems = 0;
+			path->val.array.elems =
+				palloc(sizeof(JsonbValue) * Max(v.val.array.nElems, 1));
+		}
+		else if (r == WJB_ELEM)
+		{
+			Assert(v.type == jbvString);
+			path->val.array.elems[path->val.array.nElems++] = v;
+		}
+		else if (r == WJB_END_ARRAY && path)
+		{
+			paths = lappend(paths, path);
+			path = NULL;
+		}
+	}
+
+	return paths;
+}
+
+/*
+ * Return paths of values which would be returned by ~~ operator.  Every path
+ * is an array of object keys and array indexes, values themselves are not
+ * copied.
+ */
+PG_FUNCTION_INFO_V1(jsquery_match_paths);
+Datum
+jsquery_match_paths(PG_FUNCTION_ARGS)
+{
+	FuncCallContext	*funcctx;
+	List			*paths;
+
+	if (SRF_IS_FIRSTCALL())
+	{
+		MemoryContext	oldcontext;
+
+		funcctx = SRF_FIRSTCALL_INIT();
+		oldcontext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+
+		paths = collectMatchedPaths(PG_GETARG_JSONB_P(0), PG_GETARG_JSQUERY(1));
+
+		funcctx->user_fctx = paths;
+		funcctx->max_calls = list_length(paths);
+
+		MemoryContextSwitchTo(oldcontext);
+	}
+
+	funcctx = SRF_PERCALL_SETUP();
+	paths = (List *) funcctx->user_fctx;
+
+	if (funcctx->call_cntr < funcctx->max_calls)
+	{
+		JsonbValue	*path = list_nth(paths, funcctx->call_cntr);
+		Datum		*elems;
+		int			i;
+
+		elems = palloc(sizeof(Datum) * Max(path->val.array.nElems, 1));
+		for (i = 0; i < path->val.array.nElems; i++)
+			elems[i] = PointerGetDatum(
+				cstring_to_text_with_len(path->val.array.elems[i].val.string.val,
+										 path->val.array.elems[i].val.string.len));
+
+		SRF_RETURN_NEXT(funcctx,
+						PointerGetDatum(construct_array(elems,
+														path->val.array.nElems,
+														TEXTOID, -1, false, 'i')));
+	}
+
+	SRF_RETURN_DONE(funcctx);
+}
+
+/*
+ * Copy container to the parse state replacing (or removing if newval is NULL)
+ * values located by paths.  Only the parts of the document leading to the
+ * located values are unpacked, everything else is copied as is.  In project
+ * mode located values are copied and everything else is dropped.
+ */
+static JsonbValue *
+modifyContainer(JsonbParseState **state, JsonbContainer *jbc, List *paths,
+				int depth, JsonbValue *newval, bool project)
+{
+	JsonbIterator	*it;
+	JsonbValue		v,
+					k,
+					*res = NULL;
+	int32			r;
+	int32			i = 0;
+
+	check_stack_depth();
+
+	it = JsonbIteratorInit(jbc);
+
+	while((r = JsonbIteratorNext(&it, &v, true)) != WJB_DONE)
+	{
+		if (r == WJB_KEY)
+		{
+			k = v;
+		}
+		else if (r == WJB_VALUE || r == WJB_ELEM)
+		{
+			char		buf[16];
+			char		*name;
+			int			namelen;
+			List		*sub = NIL;
+			bool		matched = false;
+			ListCell	*lc;
+
+			if (r == WJB_VALUE)
+			{
+				name = k.val.string.val;
+				namelen = k.val.string.len;
+			}
+			else
+			{
+				namelen = snprintf(buf, sizeof(buf), "%d", i++);
+				name = buf;
+			}
+
+			foreach(lc, paths)
+			{
+				JsonbValue	*path = lfirst(lc);
+				JsonbValue	*e = &path->val.array.elems[depth];
+
+				if (e->val.string.len == namelen &&
+					memcmp(e->val.string.val, name, namelen) == 0)
+				{
+					if (path->val.array.nElems == depth + 1)
+						matched = true;
+					else
+						sub = lappend(sub, path);
+				}
+			}
+
+			if (matched)
+			{
+				if (project || newval)
+				{
+					if (r == WJB_VALUE)
+						pushJsonbValue(state, WJB_KEY, &k);
+					pushJsonbValue(state, r, project ? &v : newval);
+				}
+			}
+			else if (sub != NIL && v.type == jbvBinary)
+			{
+				if (r == WJB_VALUE)
+					pushJsonbValue(state, WJB_KEY, &k);
+				modifyContainer(state, v.val.binary.data, sub, depth + 1,
+								newval, project);
+			}
+			else if (!project)
+			{
+				if (r == WJB_VALUE)
+					pushJsonbValue(state, WJB_KEY, &k);
+				pushJsonbValue(state, r, &v);
+			}
+
+			list_free(sub);
+		}
+		else
+		{
+			res = pushJsonbValue(state, r,
+								 (r == WJB_BEGIN_ARRAY || r == WJB_BEGIN_OBJECT) ?
+								 &v : NULL);
+		}
+	}
+
+	return res;
+}
+
+/*
+ * Replace (or remove if newval is NULL) values which would be returned by ~~
+ * operator.  Returns NULL if the whole document is removed.
+ */
+static Jsonb *
+modifyJsonbWhere(Jsonb *jb, JsQuery *jq, Jsonb *newjb)
+{
+	List			*paths;
+	ListCell		*lc;
+	JsonbValue		newval,
+					*newvalp = NULL;
+	JsonbParseState	*state = NULL;
+
+	paths = collectMatchedPaths(jb, jq);
+
+	if (paths == NIL)
+		return jb;
+
+	foreach(lc, paths)
+		if (((JsonbValue *) lfirst(lc))->val.array.nElems == 0)
+			return newjb;	/* the whole document is matched */
+
+	if (newjb)
+	{
+		if (JB_ROOT_IS_SCALAR(newjb))
+		{
+			JsonbIterator	*it;
+			int32			r PG_USED_FOR_ASSERTS_ONLY;
+
+			it = JsonbIteratorInit(&newjb->root);
+
+			r = JsonbIteratorNext(&it, &newval, true);
+			Assert(r == WJB_BEGIN_ARRAY);
+			Assert(newval.val.array.rawScalar == 1);
+
+			r = JsonbIteratorNext(&it, &newval, true);
+			Assert(r == WJB_ELEM);
+		}
+		else
+		{
+			newval.type = jbvBinary;
+			newval.val.binary.data = &newjb->root;
+			newval.val.binary.len = VARSIZE_ANY_EXHDR(newjb);
+		}
+		newvalp = &newval;
+	}
+
+	return JsonbValueToJsonb(modifyContainer(&state, &jb->root, paths, 0,
+											 newvalp, false));
+}
+
+PG_FUNCTION_INFO_V1(jsonb_set_where);
+Datum
+jsonb_set_where(PG_FUNCTION_ARGS)
+{
+	Jsonb			*jb = PG_GETARG_JSONB_P(0);
+	JsQuery			*jq = PG_GETARG_JSQUERY(1);
+	Jsonb			*newjb = PG_GETARG_JSONB_P(2);
+
+	PG_RETURN_JSONB_P(modifyJsonbWhere(jb, jq, newjb));
+}
+
+PG_FUNCTION_INFO_V1(jsonb_delete_where);
+Datum
+jsonb_delete_where(PG_FUNCTION_ARGS)
+{
+	Jsonb			*jb = PG_GETARG_JSONB_P(0);
+	JsQuery			*jq = PG_GETARG_JSQUERY(1);
+	Jsonb			*res;
+
+	res = modifyJsonbWhere(jb, jq, NULL);
+
+	if (res)
+		PG_RETURN_JSONB_P(res);
+
+	PG_RETURN_NULL();
+}
+
+/*
+ * Return document pruned to the values which would be returned by ~~
+ * operator, keeping their location.  Elements of arrays are renumbered.
+ */
+PG_FUNCTION_INFO_V1(jsonb_project);
+Datum
+jsonb_project(PG_FUNCTION_ARGS)
+{
+	Jsonb			*jb = PG_GETARG_JSONB_P(0);
+	JsQuery			*jq = PG_GETARG_JSQUERY(1);
+	List			*paths;
+	ListCell		*lc;
+	JsonbParseState	*state = NULL;
+
+	paths = collectMatchedPaths(jb, jq);
+
+	if (paths == NIL)
+		PG_RETURN_NULL();
+
+	foreach(lc, paths)
+		if (((JsonbValue *) lfirst(lc))->val.array.nElems == 0)
+			PG_RETURN_JSONB_P(jb);	/* the whole document is matched */
+
+	PG_RETURN_JSONB_P(JsonbValueToJsonb(modifyContainer(&state, &jb->root,
+														paths, 0, NULL,
+														true)));
+}
+
+/*
+ * Path-only jsquery prepared for typed getters.  It's cached in fn_extra
+ * while the same jsquery is passed.
+ */
+typedef struct JsQueryPathStep {
+	JsQueryItemType	type;		/* jqiKey or jqiIndexArray */
+	JsonbValue		key;
+	int32			arrayIndex;
+} JsQueryPathStep;
+
+typedef struct JsQueryPath {
+	JsQuery			*jq;		/* copy of jsquery the path was built for */
+	int				nsteps;
+	JsQueryPathStep	*steps;
+} JsQueryPath;
+
+static JsQueryPath *
+getJsQueryPath(FunctionCallInfo fcinfo, JsQuery *jq)
+{
+	JsQueryPath		*path = (JsQueryPath *) fcinfo->flinfo->fn_extra;
+	MemoryContext	oldcontext;
+	JsQueryItem		v;
+	int				n = 0;
+
+	if (path && VARSIZE(path->jq) == VARSIZE(jq) &&
+		memcmp(path->jq, jq, VARSIZE(jq)) == 0)
+		return path;
+
+	oldcontext = MemoryContextSwitchTo(fcinfo->flinfo->fn_mcxt);
+
+	path = palloc0(sizeof(JsQueryPath));
+	path->jq = palloc(VARSIZE(jq));
+	memcpy(path->jq, jq, VARSIZE(jq));
+	/* every item of jsquery takes more than four bytes */
+	path->steps = palloc(sizeof(JsQueryPathStep) * (VARSIZE(jq) / 4 + 1));
+
+	jsqInit(&v, path->jq);
+	for (;;)
+	{
+		JsQueryPathStep	*step = &path->steps[n];
+
+		switch(v.type)
+		{
+			case jqiKey:
+				step->type = jqiKey;
+				step->key.type = jbvString;
+				step->key.val.string.val = jsqGetString(&v,
+												&step->key.val.string.len);
+				n++;
+				break;
+			case jqiIndexArray:
+				step->type = jqiIndexArray;
+				step->arrayIndex = v.arrayIndex;
+				n++;
+				break;
+			case jqiCurrent:
+				break;
+			default:
+				ereport(ERROR,
+						(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						 errmsg("jsquery must be a path of keys and array indexes")));
+		}
+
+		if (jsqGetNext(&v, &v) == false)
+			break;
+	}
+	path->nsteps = n;
+
+	MemoryContextSwitchTo(oldcontext);
+
+	if (fcinfo->flinfo->fn_extra)
+	{
+		JsQueryPath	*old = (JsQueryPath *) fcinfo->flinfo->fn_extra;
+
+		pfree(old->jq);
+		pfree(old->steps);
+		pfree(old);
+	}
+	fcinfo->flinfo->fn_extra = path;
+
+	return path;
+}
+
+/*
+ * Find value located by path.  Returns false if there is no such value.
+ */
+static bool
+getJsQueryPathValue(Jsonb *jb, JsQueryPath *path, JsonbValue *res)
+{
+	JsonbValue		jbv,
+					*v = &jbv;
+	int				i;
+
+	jbv.type = jbvBinary;
+	jbv.val.binary.data = &jb->root;
+	jbv.val.binary.len = VARSIZE_ANY_EXHDR(jb);
+
+	for (i = 0; i < path->nsteps; i++)
+	{
+		JsQueryPathStep	*step = &path->steps[i];
+
+		if (step->type == jqiKey && JsonbType(v) == jbvObject)
+			v = findJsonbValueFromContainer(v->val.binary.data, JB_FOBJECT,
+											&step->key);
+		else if (step->type == jqiIndexArray && JsonbType(v) == jbvArray)
+		{
+			int32	index = getArrayIndex(v->val.binary.data,
+										  step->arrayIndex);
+
+			v = (index >= 0) ?
+				getIthJsonbValueFromContainer(v->val.binary.data, index) : NULL;
+		}
+		else
+			v = NULL;
+
+		if (v == NULL)
+			return false;
+	}
+
+	if (JsonbType(v) == jbvScalar)
+	{
+		JsonbIterator	*it;
+		int32			r PG_USED_FOR_ASSERTS_ONLY;
+
+		it = JsonbIteratorInit(v->val.binary.data);
+
+		r = JsonbIteratorNext(&it, res, true);
+		Assert(r == WJB_BEGIN_ARRAY);
+		Assert(res->val.array.rawScalar == 1);
+
+		r = JsonbIteratorNext(&it, res, true);
+		Assert(r == WJB_ELEM);
+	}
+	else
+		*res = *v;
+
+	return true;
+}
+
+/*
+ * Typed getters return value located by path-only jsquery.  NULL is returned
+ * if there is no such value or it has other type.
+ */
+PG_FUNCTION_INFO_V1(jsquery_get_text);
+Datum
+jsquery_get_text(PG_FUNCTION_ARGS)
+{
+	Jsonb			*jb = PG_GETARG_JSONB_P(0);
+	JsQueryPath		*path = getJsQueryPath(fcinfo, PG_GETARG_JSQUERY(1));
+	JsonbValue		v;
+
+	if (!getJsQueryPathValue(jb, path, &v))
+		PG_RETURN_NULL();
+
+	switch(v.type)
+	{
+		case jbvNull:
+			PG_RETURN_NULL();
+		case jbvString:
+			PG_RETURN_TEXT_P(cstring_to_text_with_len(v.val.string.val,
+													  v.val.string.len));
+		case jbvNumeric:
+			PG_RETURN_DATUM(DirectFunctionCall1(numeric_out,
+												NumericGetDatum(v.val.numeric)));
+		case jbvBool:
+			PG_RETURN_TEXT_P(cstring_to_text(v.val.boolean ? "true" : "false"));
+		case jbvBinary:
+			PG_RETURN_TEXT_P(cstring_to_text(JsonbToCString(NULL,
+															v.val.binary.data,
+															v.val.binary.len)));
+		default:
+			elog(ERROR, "Wrong jsonb type: %d", v.type);
+	}
+
+	PG_RETURN_NULL();
+}
+
+PG_FUNCTION_INFO_V1(jsquery_get_numeric);
+Datum
+jsquery_get_numeric(PG_FUNCTION_ARGS)
+{
+	Jsonb			*jb = PG_GETARG_JSONB_P(0);
+	JsQueryPath		*path = getJsQueryPath(fcinfo, PG_GETARG_JSQUERY(1));
+	JsonbValue		v;
+
+	if (!getJsQueryPathValue(jb, path, &v) || v.type != jbvNumeric)
+		PG_RETURN_NULL();
+
+	PG_RETURN_NUMERIC(DatumGetNumericCopy(NumericGetDatum(v.val.numeric)));
+}
+
+PG_FUNCTION_INFO_V1(jsquery_get_int8);
+Datum
+jsquery_get_int8(PG_FUNCTION_ARGS)
+{
+	Jsonb			*jb = PG_GETARG_JSONB_P(0);
+	JsQueryPath		*path = getJsQueryPath(fcinfo, PG_GETARG_JSQUERY(1));
+	JsonbValue		v;
+
+	if (!getJsQueryPathValue(jb, path, &v) || v.type != jbvNumeric)
+		PG_RETURN_NULL();
+
+	PG_RETURN_DATUM(DirectFunctionCall1(numeric_int8,
+										NumericGetDatum(v.val.numeric)));
+}
+
+PG_FUNCTION_INFO_V1(jsquery_get_bool);
+Datum
+jsquery_get_bool(PG_FUNCTION_ARGS)
+{
+	Jsonb			*jb = PG_GETARG_JSONB_P(0);
+	JsQueryPath		*path = getJsQueryPath(fcinfo, PG_GETARG_JSQUERY(1));
+	JsonbValue		v;
+
+	if (!getJsQueryPathValue(jb, path, &v) || v.type != jbvBool)
+		PG_RETURN_NULL();
+
+	PG_RETURN_BOOL(v.val.boolean);
+}
+
 
 static int
 compareJsQuery(JsQueryItem *v1, JsQueryItem *v2)
@@ -891,6 +1996,12 @@ compareJsQuery(JsQueryItem *v1, JsQueryItem *v2)
 			if (v1->arrayIndex != v2->arrayIndex)
 				res = (v1->arrayIndex > v2->arrayIndex) ? 1 : -1;
 			break;
+		case jqiSliceArray:
+			if (v1->slice.start != v2->slice.start)
+				res = (v1->slice.start > v2->slice.start) ? 1 : -1;
+			else if (v1->slice.end != v2->slice.end)
+				res = (v1->slice.end > v2->slice.end) ? 1 : -1;
+			break;
 		case jqiKey:
 		case jqiString:
 			{
@@ -922,6 +2033,11 @@ compareJsQuery(JsQueryItem *v1, JsQueryItem *v2)
 			break;
 		case jqiAnd:
 		case jqiOr:
+		case jqiAdd:
+		case jqiSub:
+		case jqiMul:
+		case jqiDiv:
+		case jqiFts:
 			jsqGetLeftArg(v1, &elem1);
 			jsqGetLeftArg(v2, &elem2);
 
@@ -945,6 +2061,10 @@ compareJsQuery(JsQueryItem *v1, JsQueryItem *v2)
 		case jqiContained:
 		case jqiOverlap:
 		case jqiNot:
+		case jqiRegex:
+		case jqiLike:
+		case jqiIEqual:
+		case jqiPath:
 			jsqGetArg(v1, &elem1);
 			jsqGetArg(v2, &elem2);
 
@@ -1158,6 +2278,11 @@ hashJsQuery(JsQueryItem *v, pg_crc32 *crc)
 			break;
 		case jqiAnd:
 		case jqiOr:
+		case jqiAdd:
+		case jqiSub:
+		case jqiMul:
+		case jqiDiv:
+		case jqiFts:
 			jsqGetLeftArg(v, &elem);
 			hashJsQuery(&elem, crc);
 			jsqGetRightArg(v, &elem);
@@ -1173,6 +2298,10 @@ hashJsQuery(JsQueryItem *v, pg_crc32 *crc)
 		case jqiContains:
 		case jqiContained:
 		case jqiOverlap:
+		case jqiRegex:
+		case jqiLike:
+		case jqiIEqual:
+		case jqiPath:
 			jsqGetArg(v, &elem);
 			hashJsQuery(&elem, crc);
 			break;
@@ -1189,6 +2318,10 @@ hashJsQuery(JsQueryItem *v, pg_crc32 *crc)
 		case jqiIndexArray:
 			COMP_CRC32(*crc, &v->arrayIndex, sizeof(v->arrayIndex));
 			break;
+		case jqiSliceArray:
+			COMP_CRC32(*crc, &v->slice.start, sizeof(v->slice.start));
+			COMP_CRC32(*crc, &v->slice.end, sizeof(v->slice.end));
+			break;
 		default:
 			elog(ERROR, "Unknown JsQueryItem type: %d", v->type);
 	}
@@ -15,6 +15,8 @@
 
 #include "postgres.h"
 
+#include "utils/builtins.h"
+
 #include "jsquery.h"
 
 #define read_byte(v, b, p) do {		\
@@ -87,6 +89,10 @@ jsqInitByBuffer(JsQueryItem *v, char *base, int32 pos)
 		case jqiIndexArray:
 			read_int32(v->arrayIndex, base, pos);
 			break;
+		case jqiSliceArray:
+			read_int32(v->slice.start, base, pos);
+			read_int32(v->slice.end, base, pos);
+			break;
 		case jqiKey:
 		case jqiString:
 			read_int32(v->value.datalen, base, pos);
@@ -104,6 +110,11 @@ jsqInitByBuffer(JsQueryItem *v, char *base, int32 pos)
 			break;
 		case jqiAnd:
 		case jqiOr:
+		case jqiAdd:
+		case jqiSub:
+		case jqiMul:
+		case jqiDiv:
+		case jqiFts:
 			read_int32(v->args.left, base, pos);
 			read_int32(v->args.right, base, pos);
 			break;
@@ -118,6 +129,10 @@ jsqInitByBuffer(JsQueryItem *v, char *base, int32 pos)
 		case jqiIn:
 		case jqiNot:
 		case jqiFilter:
+		case jqiRegex:
+		case jqiLike:
+		case jqiIEqual:
+		case jqiPath:
 			read_int32(v->arg, base, pos);
 			break;
 		default:
@@ -140,7 +155,11 @@ jsqGetArg(JsQueryItem *v, JsQueryItem *a)
 		v->type == jqiOverlap ||
 		v->type == jqiFilter ||
 		v->type == jqiIn ||
-		v->type == jqiNot
+		v->type == jqiNot ||
+		v->type == jqiRegex ||
+		v->type == jqiLike ||
+		v->type == jqiIEqual ||
+		v->type == jqiPath
 	);
 
 	jsqInitByBuffer(a, v->base, v->arg);
@@ -155,6 +174,7 @@ jsqGetNext(JsQueryItem *v, JsQueryItem *a)
 			v->type == jqiKey ||
 			v->type == jqiAny ||
 			v->type == jqiIndexArray ||
+			v->type == jqiSliceArray ||
 			v->type == jqiAnyArray ||
 			v->type == jqiAnyKey ||
 			v->type == jqiAll ||
@@ -162,7 +182,12 @@ jsqGetNext(JsQueryItem *v, JsQueryItem *a)
 			v->type == jqiAllKey ||
 			v->type == jqiCurrent ||
 			v->type == jqiFilter ||
-			v->type == jqiLength
+			v->type == jqiLength ||
+			v->type == jqiPath ||
+			v->type == jqiAdd ||
+			v->type == jqiSub ||
+			v->type == jqiMul ||
+			v->type == jqiDiv
 		);
 
 		if (a)
@@ -178,7 +203,12 @@ jsqGetLeftArg(JsQueryItem *v, JsQueryItem *a)
 {
 	Assert(
 		v->type == jqiAnd ||
-		v->type == jqiOr
+		v->type == jqiOr ||
+		v->type == jqiAdd ||
+		v->type == jqiSub ||
+		v->type == jqiMul ||
+		v->type == jqiDiv ||
+		v->type == jqiFts
 	);
 
 	jsqInitByBuffer(a, v->base, v->args.left);
@@ -189,7 +219,12 @@ jsqGetRightArg(JsQueryItem *v, JsQueryItem *a)
 {
 	Assert(
 		v->type == jqiAnd ||
-		v->type == jqiOr
+		v->type == jqiOr ||
+		v->type == jqiAdd ||
+		v->type == jqiSub ||
+		v->type == jqiMul ||
+		v->type == jqiDiv ||
+		v->type == jqiFts
 	);
 
 	jsqInitByBuffer(a, v->base, v->args.right);
@@ -232,6 +267,16 @@ jsqGetString(JsQueryItem *v, int32 *len)
 	return v->value.data;
 }
 
+/*
+ * Look up text search configuration named by string item.
+ */
+Oid
+jsqGetTSConfig(JsQueryItem *v)
+{
+	return DatumGetObjectId(DirectFunctionCall1(regconfigin,
+								CStringGetDatum(jsqGetString(v, NULL))));
+}
+
 void
 jsqIterateInit(JsQueryItem *v)
 {
@@ -105,6 +105,30 @@ select  'is.not  < 1'::jsquery;
 
 select 'a.b.#4 > 4'::jsquery;
 select 'a.b.#10203.* > 4'::jsquery;
+select 'a.b.#-1 > 4'::jsquery;
+select 'a.b.#0:3 > 4'::jsquery;
+select 'a.b.#-3: > 4'::jsquery;
+select 'a.#1:-1.c = 4'::jsquery;
+select 'updated > $.created'::jsquery;
+select 'price * $.qty > 1000'::jsquery;
+select 'a = $.b + 1'::jsquery;
+select 'x > 2 * 3 + 1'::jsquery;
+select 'a.#(x - $.y / 2 >= ($.z + 1) * 2)'::jsquery;
+select 'a - $.b - (1 - $.c) < $'::jsquery;
+select 'a.#: > $.b'::jsquery;
+select 'a.%: > $.b'::jsquery;
+select 'a.*: > $.b'::jsquery;
+select 'a > $.b.#:'::jsquery;
+select 'a.#: * 2 > 1'::jsquery;
+select 'a-b = 1'::jsquery;
+select '"a-b" = 1'::jsquery;
+select 'a/b = 1'::jsquery;
+select 'status = in-progress'::jsquery;
+select 'a = 2017-01-01'::jsquery;
+select 'a = $.b+1'::jsquery;
+select 'a - 1 > 2'::jsquery;
+select 'a -1 > 2'::jsquery;
+select 'a = -1 + 2'::jsquery;
 
 select '{"a": {"b": null}}'::jsonb @@ 'a.b = 1'::jsquery;
 select '{"a": {"b": null}}'::jsonb @@ 'a.b = null'::jsquery;
@@ -214,6 +238,40 @@ select '{"a": {"b": [1,2,3]}}'::jsonb @@ 'a.b.#3 = 2'::jsquery;
 select '{"a": {"b": [{"x":1},{"x":2},{"x":3}]}}'::jsonb @@ 'a.b.#1.x = 2'::jsquery;
 select '{"a": {"b": [{"x":1},{"x":2},{"x":3}]}}'::jsonb @@ 'a.b.#2.x = 2'::jsquery;
 select '{"a": {"b": [{"x":1},{"x":2},{"x":3}]}}'::jsonb @@ 'a.b.#3.x = 2'::jsquery;
+select '{"a": {"b": [1,2,3]}}'::jsonb @@ 'a.b.#-1 = 3'::jsquery;
+select '{"a": {"b": [1,2,3]}}'::jsonb @@ 'a.b.#-3 = 1'::jsquery;
+select '{"a": {"b": [1,2,3]}}'::jsonb @@ 'a.b.#-4 = 1'::jsquery;
+select '{"a": {"b": [1,2,3]}}'::jsonb @@ 'a.b.#0:2 = 2'::jsquery;
+select '{"a": {"b": [1,2,3]}}'::jsonb @@ 'a.b.#0:2 = 3'::jsquery;
+select '{"a": {"b": [1,2,3]}}'::jsonb @@ 'a.b.#-2: = 3'::jsquery;
+select '{"a": {"b": [1,2,3]}}'::jsonb @@ 'a.b.#-2: = 1'::jsquery;
+select '{"a": {"b": [1,2,3]}}'::jsonb @@ 'a.b.#1:-1 = 2'::jsquery;
+select '{"a": {"b": [1,2,3]}}'::jsonb @@ 'a.b.#1:-1 = 3'::jsquery;
+select '{"a": {"b": [1,2,3]}}'::jsonb @@ 'a.b.#5:10 = *'::jsquery;
+select '{"a": {"b": [1,2,3]}}'::jsonb ~~ 'a.b.#-2:'::jsquery;
+select '{"a": {"b": [1,2,3]}}'::jsonb ~~ 'a.b.#0:2'::jsquery;
+select '{"a": {"b": [1,2,3]}}'::jsonb ~~ 'a.b.#-10:1'::jsquery;
+select '{"created": 10, "updated": 20}'::jsonb @@ 'updated > $.created'::jsquery;
+select '{"created": 10, "updated": 20}'::jsonb @@ 'created > $.updated'::jsquery;
+select '{"created": 10}'::jsonb @@ 'created >= $.updated'::jsquery;
+select '{"price": 12.5, "qty": 100}'::jsonb @@ 'price * $.qty > 1000'::jsquery;
+select '{"price": 12.5, "qty": 100}'::jsonb @@ 'price * $.qty > 2000'::jsquery;
+select '{"price": 12.5, "qty": 100}'::jsonb @@ 'qty - $.price * 8 = 0'::jsquery;
+select '{"a": 3, "b": 2}'::jsonb @@ 'a = $.b + 1'::jsquery;
+select '{"a-b": 1, "a": 3, "b": 2}'::jsonb @@ 'a-b = 1'::jsquery;
+select '{"a": 3, "b": 2}'::jsonb @@ 'a - 1 = $.b'::jsquery;
+select '{"status": "in-progress"}'::jsonb @@ 'status = in-progress'::jsquery;
+select '{"a": 3, "b": 2}'::jsonb @@ 'a = $.b'::jsquery;
+select '{"a": "x", "b": {"c": "x"}}'::jsonb @@ 'a = $.b.c'::jsquery;
+select '{"a": 1, "b": 0}'::jsonb @@ 'a / $.b > 0'::jsquery;
+select '{"a": 1, "b": "0"}'::jsonb @@ 'a + $.b = 1'::jsquery;
+select '{"a": [1,2,3], "n": 3}'::jsonb @@ 'a.@# = $.n'::jsquery;
+select '{"a": [1,2,3], "n": [4,5]}'::jsonb @@ 'a.# = $.n.#'::jsquery;
+select '{"a": [1,2,3], "n": [3,5]}'::jsonb @@ 'a.# = $.n.#'::jsquery;
+select '{"items": [{"p": 2, "q": 3}, {"p": 5, "q": 1}]}'::jsonb @@ 'items.#(p * $.q = 6)'::jsquery;
+select '{"items": [{"p": 2, "q": 3}, {"p": 5, "q": 1}]}'::jsonb @@ 'items.#(p > $.q AND q = 3)'::jsquery;
+select '{"items": [{"p": 2, "q": 3}, {"p": 5, "q": 1}]}'::jsonb @@ 'items.#(p > $.q AND q = 1)'::jsquery;
+select '5'::jsonb @@ '$ * 2 = 10'::jsquery;
 
 select '"XXX"'::jsonb @@ '$="XXX"'::jsquery;
 select '"XXX"'::jsonb @@ '#.$="XXX"'::jsquery;
@@ -257,6 +315,60 @@ select '{"as": false}' @@ '$ IS object'::jsquery;
 select '"xxx"' @@ '$ IS string'::jsquery;
 select '"xxx"' @@ '$ IS numeric'::jsquery;
 
+--regex and LIKE
+select 'a ~ "^fo+b"'::jsquery;
+select 'a like "%foo_"'::jsquery;
+select 'a ~ "^a\\.b$"'::jsquery;
+select 'a ~ x and like LIKE "y%"'::jsquery;
+select 'a~b = 1'::jsquery;
+select '{"a~b": 1}'::jsonb @@ 'a~b = 1'::jsquery;
+select '{"a": "foobar"}'::jsonb @@ 'a ~ "^fo+b"'::jsquery;
+select '{"a": "foobar"}'::jsonb @@ 'a ~ "^bar"'::jsquery;
+select '{"a": "foobar"}'::jsonb @@ 'a ~ "bar$"'::jsquery;
+select '{"a": "a.b"}'::jsonb @@ 'a ~ "^a\\.b$"'::jsquery;
+select '{"a": "axb"}'::jsonb @@ 'a ~ "^a\\.b$"'::jsquery;
+select '{"a": 1}'::jsonb @@ 'a ~ "1"'::jsquery;
+select '{"a": "foobar"}'::jsonb @@ 'a like "foo%"'::jsquery;
+select '{"a": "foobar"}'::jsonb @@ 'a like "%bar"'::jsquery;
+select '{"a": "foobar"}'::jsonb @@ 'a like "bar%"'::jsquery;
+select '{"a": "foobar"}'::jsonb @@ 'a like "f_o%"'::jsquery;
+select '{"a": "foobar"}'::jsonb @@ 'not a like "%oo%"'::jsquery;
+select '{"a": ["abc", "xyz"]}'::jsonb @@ 'a.# ~ "^x"'::jsquery;
+select '{"a": ["abc", "xyz"]}'::jsonb @@ 'a.#: like "%b%"'::jsquery;
+
+--full text search
+select 'a @@@ "fast & cheap"'::jsquery;
+select 'a.# @@@ english "fast | !cheap"'::jsquery;
+select '{"a": "Fast and cheap cars"}'::jsonb @@ 'a @@@ english "fast & cheap"'::jsquery;
+select '{"a": "Fast and cheap cars"}'::jsonb @@ 'a @@@ english "fast & car"'::jsquery;
+select '{"a": "Fast and cheap cars"}'::jsonb @@ 'a @@@ english "fast & !cheap"'::jsquery;
+select '{"a": "Fast and cheap cars"}'::jsonb @@ 'a @@@ english "slow | cheap"'::jsquery;
+select '{"a": "Fast and cheap cars"}'::jsonb @@ 'a @@@ english "slow"'::jsquery;
+select '{"a": 1}'::jsonb @@ 'a @@@ english "1"'::jsquery;
+select '{"a": ["quick fox", "lazy dog"]}'::jsonb @@ 'a.# @@@ english "dogs"'::jsquery;
+select '{"a": "Fast and cheap cars"}'::jsonb @@ 'a @@@ "fast & car"'::jsquery;
+select '{"a": "Fast and cheap cars"}'::jsonb @@ 'a @@@ "fast & cars"'::jsquery;
+set default_text_search_config = 'english';
+select '{"a": "Fast and cheap cars"}'::jsonb @@ 'a @@@ "fast & car"'::jsquery;
+RESET default_text_search_config;
+select 'a @@@ nosuchcfg "fast"'::jsquery;
+--case-insensitive equality
+select 'a ~= "Foo"'::jsquery;
+select 'a.# ~= "foo" and b ~= "BAR"'::jsquery;
+select '{"a": "FooBar"}'::jsonb @@ 'a ~= "foobar"'::jsquery;
+select '{"a": "FooBar"}'::jsonb @@ 'a ~= "FOOBAR"'::jsquery;
+select '{"a": "FooBar"}'::jsonb @@ 'a ~= "foo"'::jsquery;
+select '{"a": "FooBar"}'::jsonb @@ 'a = "foobar"'::jsquery;
+select '{"a": 1}'::jsonb @@ 'a ~= "1"'::jsquery;
+select '{"a": ["x", "Y"]}'::jsonb @@ 'a.# ~= "y"'::jsquery;
+
+--match against many queries
+select jsquery_match_any('{"a": 1, "b": "x"}', array['a = 1', 'b = "y"', 'a > 0 and b = "x"', 'c = *', 'not c = *']::jsquery[]);
+select jsquery_match_any('{"a": [1, 2], "b": {"c": true}}', array['a.# = 2', 'a.# > 5', 'b.c = true', 'b.% = false', '* = true', 'a && [3, 4]']::jsquery[]);
+select jsquery_match_any('{"a": 1}', array['a = 1', null, 'a = 1']::jsquery[]);
+select jsquery_match_any('{"a": 1}', '[0:1]={"a = 2","a = 1"}'::jsquery[]);
+select jsquery_match_any('{"a": 1}', array[]::jsquery[]);
+
 --hint
 
 select 'a /*-- noindex */ = 5'::jsquery;
@@ -328,6 +440,45 @@ select '{"a": {"b": {"c": 1}}}'::jsonb ~~ '*.?(c >0)'::jsquery;
 select '{"a": {"b": {"c": 1}}}'::jsonb ~~ '?(*.c >0)'::jsquery;
 select '{"tags":[{"term":["NYC", "CYN"]}, {"term":["1NYC", "1CYN"]} ]}'::jsonb ~~ 'tags.#.term.#. ? ( $ = "NYC")'::jsquery;
 select '{"tags":[{"term":["NYC", "CYN"]}, {"term":["1NYC", "1CYN"]} ]}'::jsonb ~~ 'tags.#.term. ? ( # = "NYC")'::jsquery;
+select jsquery_match_paths('[{"a":1, "b":10}, {"a":2, "b":20}]'::jsonb, '#. ?(a > 1). b'::jsquery);
+select jsquery_match_paths('{"a":1, "b":2, "c":3}'::jsonb, '%'::jsquery);
+select jsquery_match_paths('[1,2,3]'::jsonb, '#. ?($ > 2)'::jsquery);
+select jsquery_match_paths('{"a": {"b": {"c": 1}}}'::jsonb, '*.?(c >0)'::jsquery);
+select jsquery_match_paths('{"tags":[{"term":["NYC", "CYN"]}, {"term":["1NYC", "1CYN"]} ]}'::jsonb, 'tags.#.term.#. ? ( $ = "NYC")'::jsquery);
+select jsquery_match_paths('{"a": {"b": 1, "c": 2}, "b": {"d":3}}'::jsonb, 'a.b and b.d'::jsquery);
+select jsquery_match_paths('{"a": {"b": 1, "c": 2}, "b": {"d":3}}'::jsonb, '(a.e or a.g) and b.d'::jsquery);
+select jsquery_match_paths('{"a": 1}'::jsonb, '$'::jsquery);
+select jsonb_set_where('{"items": [{"qty": 0, "status": "new"}, {"qty": 5, "status": "new"}, {"qty": 0, "status": "new"}]}'::jsonb, 'items.#.?(qty = 0).status'::jsquery, '"void"'::jsonb);
+select jsonb_delete_where('{"items": [{"qty": 0, "status": "new"}, {"qty": 5, "status": "new"}, {"qty": 0, "status": "new"}]}'::jsonb, 'items.#.?(qty = 0)'::jsquery);
+select jsonb_set_where('{"a": 1, "b": {"c": 2}}'::jsonb, 'b.c'::jsquery, '{"d": [1, 2]}'::jsonb);
+select jsonb_set_where('{"a": {"b": 1, "c": 2}, "b": {"d":3}}'::jsonb, 'a.b and b.d'::jsquery, 'null'::jsonb);
+select jsonb_set_where('{"a": 1}'::jsonb, 'b'::jsquery, '2'::jsonb);
+select jsonb_set_where('[1,2,3]'::jsonb, '$'::jsquery, '"x"'::jsonb);
+select jsonb_delete_where('{"a":1, "b":2, "c":3}'::jsonb, '% . ? ( $ > 1 )'::jsquery);
+select jsonb_delete_where('[1,2,3,4]'::jsonb, '#. ?($ > 2)'::jsquery);
+select jsonb_delete_where('{"a": 1}'::jsonb, '$'::jsquery);
+select jsonb_project('{"a": {"b": 1, "c": 2}, "d": [1, 2, 3]}'::jsonb, 'a.b and d.#.?($ > 1)'::jsquery);
+select jsonb_project('{"items": [{"qty": 0, "status": "new"}, {"qty": 5, "status": "new"}]}'::jsonb, 'items.#.?(qty = 5).status'::jsquery);
+select jsonb_project('{"a": {"b": {"c": 1}}, "e": 2}'::jsonb, '*.?(c >0)'::jsquery);
+select jsonb_project('{"a": 1}'::jsonb, 'b'::jsquery);
+select jsonb_project('[1, 2]'::jsonb, '$'::jsquery);
+select jsquery_get_numeric('{"a": {"b": [1.5, "x", true, null, {"c": 2}]}, "d": 10}'::jsonb, 'a.b.#0'::jsquery);
+select jsquery_get_int8('{"a": {"b": [1.5, "x", true, null, {"c": 2}]}, "d": 10}'::jsonb, 'd'::jsquery);
+select jsquery_get_bool('{"a": {"b": [1.5, "x", true, null, {"c": 2}]}, "d": 10}'::jsonb, 'a.b.#2'::jsquery);
+select jsquery_get_text('{"a": {"b": [1.5, "x", true, null, {"c": 2}]}, "d": 10}'::jsonb, 'a.b.#1'::jsquery);
+select jsquery_get_text('{"a": {"b": [1.5, "x", true, null, {"c": 2}]}, "d": 10}'::jsonb, 'a.b.#4'::jsquery);
+select jsquery_get_text('{"a": {"b": [1.5, "x", true, null, {"c": 2}]}, "d": 10}'::jsonb, 'a.b.#0'::jsquery);
+select jsquery_get_text('{"a": {"b": [1.5, "x", true, null, {"c": 2}]}, "d": 10}'::jsonb, 'a.b.#3'::jsquery);
+select jsquery_get_numeric('{"a": {"b": [1.5, "x", true, null, {"c": 2}]}, "d": 10}'::jsonb, 'a.b.#1'::jsquery);
+select jsquery_get_numeric('{"a": {"b": [1.5, "x", true, null, {"c": 2}]}, "d": 10}'::jsonb, 'a.b.#4.c'::jsquery);
+select jsquery_get_int8('{"a": {"b": [1.5, "x", true, null, {"c": 2}]}, "d": 10}'::jsonb, 'a.x'::jsquery);
+select jsquery_get_text('"x"'::jsonb, '$'::jsquery);
+select jsquery_get_text('{"a": {"b": [1.5, "x", true, null, {"c": 2}]}, "d": 10}'::jsonb, 'a.b.# = 1'::jsquery);
+select length(jsquery_signature('{"a": 1, "b": [true, "x"]}'::jsonb));
+select jsquery_signature('{"a": 1, "b": [true, "x"]}'::jsonb) ?@@ 'a = 1'::jsquery;
+select jsquery_signature('{"a": 1, "b": [true, "x"]}'::jsonb) ?@@ 'b.# = "x"'::jsquery;
+select jsquery_signature('{"a": 1, "b": [true, "x"]}'::jsonb) ?@@ 'b.#: is boolean or c = 1'::jsquery;
+select jsquery_signature('{"a": 1, "b": [true, "x"]}'::jsonb) ?@@ 'not c = 1'::jsquery;
 
 --ALL
 select 'a.*: = 4'::jsquery;
@@ -415,6 +566,15 @@ SELECT gin_debug_query_path_value('x is string');
 SELECT gin_debug_query_path_value('x is numeric');
 SELECT gin_debug_query_path_value('x is array');
 SELECT gin_debug_query_path_value('x is object');
+SELECT gin_debug_query_path_value('x like "%abc%"');
+SELECT gin_debug_query_path_value('x ~ "^abc" and y = 1');
+SELECT gin_debug_query_path_value('NOT x ~ "abc"');
+SELECT gin_debug_query_path_value('x @@@ "fast & cheap"');
+SELECT gin_debug_query_path_value('x @@@ "!fast" and y = 1');
+SELECT gin_debug_query_path_value('x ~= "Foo"');
+SELECT gin_debug_query_path_value('updated > $.created');
+SELECT gin_debug_query_path_value('x = 1 and price * $.qty > 1000');
+SELECT gin_debug_query_path_value('x > 2 * 3');
 SELECT gin_debug_query_path_value('#:(x=1) AND %:(y=1) AND *:(z=1)');
 SELECT gin_debug_query_path_value('#:(NOT x=1) AND %:(NOT y=1) AND *:(NOT z=1)');
 SELECT gin_debug_query_path_value('NOT #:(NOT x=1) AND NOT %:(NOT y=1) AND NOT *:(NOT z=1)');
@@ -442,6 +602,12 @@ SELECT gin_debug_query_value_path('x is string');
 SELECT gin_debug_query_value_path('x is numeric');
 SELECT gin_debug_query_value_path('x is array');
 SELECT gin_debug_query_value_path('x is object');
+SELECT gin_debug_query_value_path('x like "%abc%"');
+SELECT gin_debug_query_value_path('x ~ "^abc" and y = 1');
+SELECT gin_debug_query_value_path('NOT x ~ "abc"');
+SELECT gin_debug_query_value_path('x @@@ "fast & cheap"');
+SELECT gin_debug_query_value_path('x @@@ "!fast" and y = 1');
+SELECT gin_debug_query_value_path('x ~= "Foo"');
 SELECT gin_debug_query_value_path('#:(x=1) AND %:(y=1) AND *:(z=1)');
 SELECT gin_debug_query_value_path('#:(NOT x=1) AND %:(NOT y=1) AND *:(NOT z=1)');
 SELECT gin_debug_query_value_path('NOT #:(NOT x=1) AND NOT %:(NOT y=1) AND NOT *:(NOT z=1)');
@@ -504,6 +670,28 @@ select count(*) from test_jsquery where v @@ '$'::jsquery;
 select count(*) from test_jsquery where v @@ 'similar_product_ids.#'::jsquery;
 select count(*) from test_jsquery where v @@ '$ . ? (review_votes > 10) . review_rating < 7'::jsquery;
 select count(*) from test_jsquery where v @@ 'similar_product_ids . ? (# = "B0002W4TL2") . $'::jsquery;
+select count(*) from test_jsquery where jsquery_signature(v) ?@@ 'review_helpful_votes = 19'::jsquery and v @@ 'review_helpful_votes = 19'::jsquery;
+select count(*) from test_jsquery where jsquery_signature(v) ?@@ 'product_group = false'::jsquery and v @@ 'product_group = false'::jsquery;
+select count(*) from test_jsquery where jsquery_signature(v) ?@@ 'similar_product_ids && ["0440180295"] and product_sales_rank > 300000'::jsquery and v @@ 'similar_product_ids && ["0440180295"] and product_sales_rank > 300000'::jsquery;
+select count(*) from test_jsquery where jsquery_signature(v) ?@@ 't is string'::jsquery and v @@ 't is string'::jsquery;
+select count(*) from test_jsquery where jsquery_signature(v) ?@@ 'customer_id = null'::jsquery and v @@ 'customer_id = null'::jsquery;
+select count(*) from test_jsquery where jsquery_signature(v) ?@@ 'review_helpful_votes > 16 and review_helpful_votes < 20'::jsquery and v @@ 'review_helpful_votes > 16 and review_helpful_votes < 20'::jsquery;
+select count(*) from test_jsquery where not jsquery_signature(v) ?@@ 'review_helpful_votes = 19'::jsquery and v @@ 'review_helpful_votes = 19'::jsquery;
+select count(*) from test_jsquery where not jsquery_signature(v) ?@@ 'product_group = false'::jsquery and v @@ 'product_group = false'::jsquery;
+select count(*) from test_jsquery where not jsquery_signature(v) ?@@ 'similar_product_ids && ["0440180295"] and product_sales_rank > 300000'::jsquery and v @@ 'similar_product_ids && ["0440180295"] and product_sales_rank > 300000'::jsquery;
+select count(*) from test_jsquery where not jsquery_signature(v) ?@@ 't is string'::jsquery and v @@ 't is string'::jsquery;
+select count(*) from test_jsquery where not jsquery_signature(v) ?@@ 'customer_id = null'::jsquery and v @@ 'customer_id = null'::jsquery;
+select count(*) from test_jsquery where not jsquery_signature(v) ?@@ 'review_helpful_votes > 16 and review_helpful_votes < 20'::jsquery and v @@ 'review_helpful_votes > 16 and review_helpful_votes < 20'::jsquery;
+select sum(cardinality(jsquery_match_any(v, array['review_helpful_votes > 19', 'similar_product_ids && ["0440180295"]', 'customer_id = null', 't = *', 'product_group = "DVD"']::jsquery[]))) from test_jsquery;
+select count(*) from test_jsquery where 5 = any(jsquery_match_any(v, array['review_helpful_votes > 19', 'similar_product_ids && ["0440180295"]', 'customer_id = null', 't = *', 'product_group = "DVD"']::jsquery[]));
+select count(*) from test_jsquery where v @@ 'product_group ~= "book"'::jsquery;
+select count(*) from test_jsquery where v @@ 'product_title ~= "the secret of the shadow"'::jsquery;
+select count(*) from test_jsquery where v @@ 'product_title @@@ english "harry & potter"'::jsquery;
+select count(*) from test_jsquery where v @@ 'product_title @@@ english "secrets | wars"'::jsquery;
+select count(*) from test_jsquery where v @@ 'product_title @@@ english "potter & !chamber"'::jsquery;
+select count(*) from test_jsquery where v @@ 'product_title like "%Love%"'::jsquery;
+select count(*) from test_jsquery where v @@ 'product_title ~ "^The "'::jsquery;
+select count(*) from test_jsquery where v @@ 'product_subcategory ~ "[Ff]iction"'::jsquery;
 
 select v from test_jsquery where v @@ 'array <@ [2,3]'::jsquery order by v;
 select v from test_jsquery where v @@ 'array && [2,3]'::jsquery order by v;
@@ -555,6 +743,14 @@ select count(*) from test_jsquery where v @@ '$'::jsquery;
 select count(*) from test_jsquery where v @@ 'similar_product_ids.#'::jsquery;
 select count(*) from test_jsquery where v @@ '$ . ? (review_votes > 10) . review_rating < 7'::jsquery;
 select count(*) from test_jsquery where v @@ 'similar_product_ids . ? (# = "B0002W4TL2") . $'::jsquery;
+select count(*) from test_jsquery where v @@ 'product_group ~= "book"'::jsquery;
+select count(*) from test_jsquery where v @@ 'product_title ~= "the secret of the shadow"'::jsquery;
+select count(*) from test_jsquery where v @@ 'product_title @@@ english "harry & potter"'::jsquery;
+select count(*) from test_jsquery where v @@ 'product_title @@@ english "secrets | wars"'::jsquery;
+select count(*) from test_jsquery where v @@ 'product_title @@@ english "potter & !chamber"'::jsquery;
+select count(*) from test_jsquery where v @@ 'product_title like "%Love%"'::jsquery;
+select count(*) from test_jsquery where v @@ 'product_title ~ "^The "'::jsquery;
+select count(*) from test_jsquery where v @@ 'product_subcategory ~ "[Ff]iction"'::jsquery;
 
 explain (costs off) select v from test_jsquery where v @@ 'array <@ [2,3]'::jsquery order by v;
 explain (costs off) select v from test_jsquery where v @@ 'array && [2,3]'::jsquery order by v;
@@ -613,6 +809,14 @@ select count(*) from test_jsquery where v @@ '$'::jsquery;
 select count(*) from test_jsquery where v @@ 'similar_product_ids.#'::jsquery;
 select count(*) from test_jsquery where v @@ '$ . ? (review_votes > 10) . review_rating < 7'::jsquery;
 select count(*) from test_jsquery where v @@ 'similar_product_ids . ? (# = "B0002W4TL2") . $'::jsquery;
+select count(*) from test_jsquery where v @@ 'product_group ~= "book"'::jsquery;
+select count(*) from test_jsquery where v @@ 'product_title ~= "the secret of the shadow"'::jsquery;
+select count(*) from test_jsquery where v @@ 'product_title @@@ english "harry & potter"'::jsquery;
+select count(*) from test_jsquery where v @@ 'product_title @@@ english "secrets | wars"'::jsquery;
+select count(*) from test_jsquery where v @@ 'product_title @@@ english "potter & !chamber"'::jsquery;
+select count(*) from test_jsquery where v @@ 'product_title like "%Love%"'::jsquery;
+select count(*) from test_jsquery where v @@ 'product_title ~ "^The "'::jsquery;
+select count(*) from test_jsquery where v @@ 'product_subcategory ~ "[Ff]iction"'::jsquery;
 
 explain (costs off) select v from test_jsquery where v @@ 'array <@ [2,3]'::jsquery order by v;
 explain (costs off) select v from test_jsquery where v @@ 'array && [2,3]'::jsquery order by v;
@@ -624,4 +828,81 @@ select v from test_jsquery where v @@ 'array && [2,3]'::jsquery order by v;
 select v from test_jsquery where v @@ 'array @> [2,3]'::jsquery order by v;
 select v from test_jsquery where v @@ 'array = [2,3]'::jsquery order by v;
 
+drop index t_idx;
+create index t_idx on test_jsquery using gin (v jsonb_path_value_ops_v2);
+
+explain (costs off) select count(*) from test_jsquery where v @@ 'review_helpful_votes > 0'::jsquery;
+
+select count(*) from test_jsquery where v @@ 'review_helpful_votes > 0'::jsquery;
+select count(*) from test_jsquery where v @@ 'review_helpful_votes > 19'::jsquery;
+select count(*) from test_jsquery where v @@ 'review_helpful_votes < 19'::jsquery;
+select count(*) from test_jsquery where v @@ 'review_helpful_votes >= 19'::jsquery;
+select count(*) from test_jsquery where v @@ 'review_helpful_votes <= 19'::jsquery;
+select count(*) from test_jsquery where v @@ 'review_helpful_votes = 19'::jsquery;
+select count(*) from test_jsquery where v @@ 'review_helpful_votes > 16 and review_helpful_votes < 20'::jsquery;
+select count(*) from test_jsquery where v @@ 'review_helpful_votes ($ > 16 and $ < 20)'::jsquery;
+select count(*) from test_jsquery where v @@ 'similar_product_ids && ["0440180295"] and product_sales_rank > 300000'::jsquery;
+select count(*) from test_jsquery where v @@ 'customer_id = null'::jsquery;
+select count(*) from test_jsquery where v @@ 'review_votes = true'::jsquery;
+select count(*) from test_jsquery where v @@ 't is numeric'::jsquery;
+select count(*) from test_jsquery where v @@ '$ > 2'::jsquery;
+select count(*) from test_jsquery where v @@ '$ . ? (review_votes > 10) . review_rating < 7'::jsquery;
+
+create table test_numeric_keys (v jsonb);
+insert into test_numeric_keys select jsonb_build_object('x', x)
+	from unnest('{-1e70,-123456789,-10.5,-10,-1,-0.5,-0.001,0,0.001,0.5,1,1.0,10,10.5,123456789,1e70}'::numeric[]) x;
+create index test_numeric_keys_idx on test_numeric_keys using gin (v jsonb_path_value_ops_v2);
+explain (costs off) select count(*) from test_numeric_keys where v @@ 'x > -10'::jsquery;
+select count(*) from test_numeric_keys where v @@ 'x > -10'::jsquery;
+select count(*) from test_numeric_keys where v @@ 'x >= -10'::jsquery;
+select count(*) from test_numeric_keys where v @@ 'x < 0.001'::jsquery;
+select count(*) from test_numeric_keys where v @@ 'x = 1'::jsquery;
+select count(*) from test_numeric_keys where v @@ 'x = -0.5'::jsquery;
+select count(*) from test_numeric_keys where v @@ 'x > 0 and x < 10.5'::jsquery;
+select count(*) from test_numeric_keys where v @@ 'x >= -0.5 and x <= 0.5'::jsquery;
+select count(*) from test_numeric_keys where v @@ 'x < -123456789'::jsquery;
+select count(*) from test_numeric_keys where v @@ 'x > 123456789'::jsquery;
+select count(*) from test_numeric_keys where v @@ 'x > -1 and x < 0'::jsquery;
+select x from test_numeric_keys, jsonb_extract_path_text(v, 'x') x where v @@ 'x >= -10.5 and x < 1'::jsquery order by x::numeric;
+drop table test_numeric_keys;
+
+create index t_idx_v1 on test_jsquery using gin (v jsonb_path_value_ops);
+select pg_relation_size('t_idx') <= pg_relation_size('t_idx_v1') as v2_is_not_larger;
+drop index t_idx_v1;
+
+create table test_packed_keys (v jsonb);
+insert into test_packed_keys select jsonb_build_object('x', x::jsonb)
+	from unnest(array['null', 'true', 'false', '[]', '[1, 2]', '{}', '{"y": 1}', '"a"', '"b"', '1', '2.5', '-3']) x;
+create index test_packed_keys_idx on test_packed_keys using gin (v jsonb_path_value_ops_v2);
+explain (costs off) select count(*) from test_packed_keys where v @@ 'x is array'::jsquery;
+select count(*) from test_packed_keys where v @@ 'x is array'::jsquery;
+select count(*) from test_packed_keys where v @@ 'x is object'::jsquery;
+select count(*) from test_packed_keys where v @@ 'x is boolean'::jsquery;
+select count(*) from test_packed_keys where v @@ 'x is string'::jsquery;
+select count(*) from test_packed_keys where v @@ 'x is numeric'::jsquery;
+select count(*) from test_packed_keys where v @@ 'x = null'::jsquery;
+select count(*) from test_packed_keys where v @@ 'x = true'::jsquery;
+select count(*) from test_packed_keys where v @@ 'x = false'::jsquery;
+select count(*) from test_packed_keys where v @@ 'x <@ [1, 2, 3]'::jsquery;
+select count(*) from test_packed_keys where v @@ 'x.# = 1'::jsquery;
+select count(*) from test_packed_keys where v @@ 'x = "a"'::jsquery;
+select count(*) from test_packed_keys where v @@ 'x > 0'::jsquery;
+select count(*) from test_packed_keys where v @@ 'x < 0'::jsquery;
+select count(*) from test_packed_keys where v @@ 'x.y = 1'::jsquery;
+select count(*) from test_packed_keys where v @@ 'x = *'::jsquery;
+drop table test_packed_keys;
+
+create table test_rules (id int, q jsquery);
+insert into test_rules values
+	(1, 'a = 1'), (2, 'b = "x"'), (3, 'a > 0 and b = "y"'),
+	(4, 'c.# = 2 or d = true'), (5, 'not a = 1'), (6, 'e = *'),
+	(7, '*.f = 3'), (8, 'a = 1 and c.# = 5'), (9, 'b ~= "X"');
+create index test_rules_idx on test_rules using gin (q jsquery_path_value_ops);
+explain (costs off) select count(*) from test_rules where q @@ '{"a": 1, "b": "x"}'::jsonb;
+select array_agg(id order by id) from test_rules where q @@ '{"a": 1, "b": "x"}'::jsonb;
+select array_agg(id order by id) from test_rules where q @@ '{"a": 2, "b": "y", "c": [1, 2]}'::jsonb;
+select array_agg(id order by id) from test_rules where q @@ '{"e": null, "g": {"f": 3}}'::jsonb;
+select array_agg(id order by id) from test_rules where q @@ '{"a": 1, "c": [5]}'::jsonb;
+drop table test_rules;
+
 RESET enable_seqscan;
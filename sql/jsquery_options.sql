@@ -0,0 +1,145 @@
+-- GIN opclass options, available since PostgreSQL 13
+drop index t_idx;
+set enable_seqscan = off;
+
+--trigrams
+create index t_idx on test_jsquery using gin (v jsonb_path_value_ops (trgm = true));
+explain (costs off) select count(*) from test_jsquery where v @@ 'product_title like "%Love%"'::jsquery;
+select count(*) from test_jsquery where v @@ 'product_title like "%Love%"'::jsquery;
+select count(*) from test_jsquery where v @@ 'product_title like "%a%"'::jsquery;
+select count(*) from test_jsquery where v @@ 'product_title ~ "^The "'::jsquery;
+select count(*) from test_jsquery where v @@ 'product_title ~ "Harry Potter"'::jsquery;
+select count(*) from test_jsquery where v @@ 'product_subcategory ~ "[Ff]iction"'::jsquery;
+select count(*) from test_jsquery where v @@ 'product_title like "%Love%" and product_group = "Book"'::jsquery;
+drop index t_idx;
+
+--full text search
+create index t_idx on test_jsquery using gin (v jsonb_path_value_ops (fts = true, fts_config = english));
+explain (costs off) select count(*) from test_jsquery where v @@ 'product_title @@@ english "harry & potter"'::jsquery;
+select count(*) from test_jsquery where v @@ 'product_title @@@ english "harry & potter"'::jsquery;
+select count(*) from test_jsquery where v @@ 'product_title @@@ english "secrets | wars"'::jsquery;
+select count(*) from test_jsquery where v @@ 'product_title @@@ english "potter & !chamber"'::jsquery;
+select count(*) from test_jsquery where v @@ 'product_title @@@ english "harry & potter" and product_group = "DVD"'::jsquery;
+select count(*) from test_jsquery where v @@ 'product_title @@@ "harry & potter"'::jsquery;
+drop index t_idx;
+
+--case folding
+create index t_idx on test_jsquery using gin (v jsonb_path_value_ops (casefold = true));
+explain (costs off) select count(*) from test_jsquery where v @@ 'product_group ~= "BOOK"'::jsquery;
+select count(*) from test_jsquery where v @@ 'product_group ~= "BOOK"'::jsquery;
+select count(*) from test_jsquery where v @@ 'product_group ~= "dvd"'::jsquery;
+select count(*) from test_jsquery where v @@ 'product_title ~= "the secret of the shadow"'::jsquery;
+select count(*) from test_jsquery where v @@ 'customer_id ~= "a38qyr68ftymlf"'::jsquery;
+select count(*) from test_jsquery where v @@ 'product_group = "Book"'::jsquery;
+select count(*) from test_jsquery where v @@ 'product_group = "BOOK"'::jsquery;
+select count(*) from test_jsquery where v @> '{"product_group": "DVD"}';
+select count(*) from test_jsquery where v @@ 'product_group = "Book" and product_subcategory ~= "LITERATURE & FICTION"'::jsquery;
+drop index t_idx;
+
+--64-bit hashes
+create index t_idx on test_jsquery using gin (v jsonb_path_value_ops (hash64 = true));
+create index t_idx on test_jsquery using gin (v jsonb_path_value_ops_v2 (hash64 = true, trgm = true));
+explain (costs off) select count(*) from test_jsquery where v @@ 'review_helpful_votes = 19'::jsquery;
+select count(*) from test_jsquery where v @@ 'review_helpful_votes = 19'::jsquery;
+select count(*) from test_jsquery where v @@ 'review_helpful_votes > 16 and review_helpful_votes < 20'::jsquery;
+select count(*) from test_jsquery where v @@ 'similar_product_ids && ["0440180295"] and product_sales_rank > 300000'::jsquery;
+select count(*) from test_jsquery where v @@ 'customer_id = null'::jsquery;
+select count(*) from test_jsquery where v @@ 'review_votes = true'::jsquery;
+select count(*) from test_jsquery where v @@ 't is numeric'::jsquery;
+select count(*) from test_jsquery where v @@ '$ . ? (review_votes > 10) . review_rating < 7'::jsquery;
+select count(*) from test_jsquery where v @@ 'product_title like "%Love%"'::jsquery;
+select count(*) from test_jsquery where v @@ 'product_title ~ "Harry Potter"'::jsquery;
+select count(*) from test_jsquery where v @> '{"product_group": "DVD"}';
+drop index t_idx;
+create table test_deep_path (v jsonb);
+insert into test_deep_path select ('{"x": ' || repeat('{"a": ', 63) || '{"x": {"b": 1}}' || repeat('}', 64))::jsonb;
+create index t_idx on test_deep_path using gin (v jsonb_path_value_ops_v2 (hash64 = true));
+select count(*) from test_deep_path where v @@ ('x.' || repeat('a.', 63) || 'x.b = 1')::jsquery;
+select count(*) from test_deep_path where v @@ ('y.' || repeat('a.', 63) || 'y.b = 1')::jsquery;
+drop table test_deep_path;
+
+--path bloom filter
+create index t_idx on test_jsquery using gin (v jsonb_value_path_ops (bloom_bits = 7));
+create index t_idx on test_jsquery using gin (v jsonb_value_path_ops (bloom_width = 64));
+create index t_idx on test_jsquery using gin (v jsonb_value_path_ops (bloom_bits = 1));
+explain (costs off) select count(*) from test_jsquery where v @@ 'similar_product_ids.#($ = "0440180295") '::jsquery;
+select count(*) from test_jsquery where v @@ 'review_helpful_votes > 16 and review_helpful_votes < 20'::jsquery;
+select count(*) from test_jsquery where v @@ 'similar_product_ids.#($ = "0440180295") '::jsquery;
+select count(*) from test_jsquery where v @@ 'similar_product_ids . ? (# = "B0002W4TL2") . $'::jsquery;
+select count(*) from test_jsquery where v @@ '$ . ? (review_votes > 10) . review_rating < 7'::jsquery;
+select count(*) from test_jsquery where v @> '{"product_group": "DVD"}';
+drop index t_idx;
+create index t_idx on test_jsquery using gin (v jsonb_value_path_ops (bloom_bits = 4, bloom_width = 24));
+select count(*) from test_jsquery where v @@ 'review_helpful_votes > 16 and review_helpful_votes < 20'::jsquery;
+select count(*) from test_jsquery where v @@ 'similar_product_ids.#($ = "0440180295") '::jsquery;
+select count(*) from test_jsquery where v @@ 'similar_product_ids . ? (# = "B0002W4TL2") . $'::jsquery;
+select count(*) from test_jsquery where v @@ '$ . ? (review_votes > 10) . review_rating < 7'::jsquery;
+drop index t_idx;
+
+--path filters
+create index t_idx on test_jsquery using gin (v jsonb_path_value_ops (include_paths = 'a..b'));
+create index t_idx_full on test_jsquery using gin (v jsonb_path_value_ops);
+create index t_idx on test_jsquery using gin (v jsonb_path_value_ops (include_paths = 'review_helpful_votes, review_date.*, similar_product_ids'));
+select pg_relation_size('t_idx') < pg_relation_size('t_idx_full') as filtered_is_smaller;
+drop index t_idx_full;
+explain (costs off) select count(*) from test_jsquery where v @@ 'review_helpful_votes = 19'::jsquery;
+select count(*) from test_jsquery where v @@ 'review_helpful_votes = 19'::jsquery;
+select count(*) from test_jsquery where v @@ 'review_helpful_votes > 16 and review_helpful_votes < 20'::jsquery;
+select count(*) from test_jsquery where v @@ 'similar_product_ids && ["0440180295"] and product_sales_rank > 300000'::jsquery;
+select count(*) from test_jsquery where v @@ 'similar_product_ids.#($ = "0440180295") '::jsquery;
+select count(*) from test_jsquery where v @@ 'customer_id = null'::jsquery;
+select count(*) from test_jsquery where v @@ 'review_votes = true'::jsquery;
+select count(*) from test_jsquery where v @@ '$ . ? (review_votes > 10) . review_rating < 7'::jsquery;
+select count(*) from test_jsquery where v @> '{"product_group": "DVD"}';
+drop index t_idx;
+create index t_idx on test_jsquery using gin (v jsonb_value_path_ops (exclude_paths = 'similar_product_ids, "review_date"'));
+select count(*) from test_jsquery where v @@ 'review_helpful_votes = 19'::jsquery;
+select count(*) from test_jsquery where v @@ 'review_helpful_votes > 16 and review_helpful_votes < 20'::jsquery;
+select count(*) from test_jsquery where v @@ 'similar_product_ids && ["0440180295"] and product_sales_rank > 300000'::jsquery;
+select count(*) from test_jsquery where v @@ 'similar_product_ids.#($ = "0440180295") '::jsquery;
+select count(*) from test_jsquery where v @@ 'customer_id = null'::jsquery;
+select count(*) from test_jsquery where v @@ 'review_votes = true'::jsquery;
+select count(*) from test_jsquery where v @@ '$ . ? (review_votes > 10) . review_rating < 7'::jsquery;
+select count(*) from test_jsquery where v @> '{"product_group": "DVD"}';
+select count(*) from test_jsquery where v @> '{"similar_product_ids": ["0440180295"]}';
+drop index t_idx;
+
+--bounded extraction
+create index t_idx on test_jsquery using gin (v jsonb_path_value_ops_v2 (max_array_length = 2, max_depth = 1));
+explain (costs off) select count(*) from test_jsquery where v @@ 'similar_product_ids.#($ = "0440180295") '::jsquery;
+select count(*) from test_jsquery where v @@ 'similar_product_ids.#($ = "0440180295") '::jsquery;
+select count(*) from test_jsquery where v @@ 'similar_product_ids && ["0440180295"] and product_sales_rank > 300000'::jsquery;
+select count(*) from test_jsquery where v @@ 'similar_product_ids . ? (# = "B0002W4TL2") . $'::jsquery;
+select count(*) from test_jsquery where v @@ 'review_helpful_votes = 19'::jsquery;
+select count(*) from test_jsquery where v @@ 'review_date."$date" = 1013644800000'::jsquery;
+select count(*) from test_jsquery where v @> '{"similar_product_ids": ["0440180295"]}';
+select count(*) from test_jsquery where v @> '{"product_group": "DVD"}';
+drop index t_idx;
+create index t_idx on test_jsquery using gin (v jsonb_path_value_ops (max_array_length = 1, max_depth = 1));
+select count(*) from test_jsquery where v @@ 'similar_product_ids.#($ = "0440180295") '::jsquery;
+select count(*) from test_jsquery where v @@ 'similar_product_ids && ["0440180295"] and product_sales_rank > 300000'::jsquery;
+select count(*) from test_jsquery where v @@ 'similar_product_ids . ? (# = "B0002W4TL2") . $'::jsquery;
+select count(*) from test_jsquery where v @@ 'review_helpful_votes = 19'::jsquery;
+select count(*) from test_jsquery where v @@ 'review_date."$date" = 1013644800000'::jsquery;
+select count(*) from test_jsquery where v @> '{"similar_product_ids": ["0440180295"]}';
+select count(*) from test_jsquery where v @> '{"product_group": "DVD"}';
+drop index t_idx;
+
+--positional entries
+create index t_idx on test_jsquery using gin (v jsonb_path_value_ops_v2 (array_positions = 2));
+explain (costs off) select count(*) from test_jsquery where v @@ 'similar_product_ids.#0 = "0439064864"'::jsquery;
+select count(*) from test_jsquery where v @@ 'similar_product_ids.#0 = "0439064864"'::jsquery;
+select count(*) from test_jsquery where v @@ 'similar_product_ids.#1 = "043935806X"'::jsquery;
+select count(*) from test_jsquery where v @@ 'similar_product_ids.#2 = "0440180295"'::jsquery;
+select count(*) from test_jsquery where v @@ 'similar_product_ids.#-1 = "B00005JMAH"'::jsquery;
+select count(*) from test_jsquery where v @@ 'similar_product_ids.#0 = "0440180295"'::jsquery;
+drop index t_idx;
+create index t_idx on test_jsquery using gin (v jsonb_path_value_ops (array_positions = 1));
+select count(*) from test_jsquery where v @@ 'similar_product_ids.#0 = "0439064864"'::jsquery;
+select count(*) from test_jsquery where v @@ 'similar_product_ids.#1 = "043935806X"'::jsquery;
+select count(*) from test_jsquery where v @@ 'similar_product_ids.#2 = "0440180295"'::jsquery;
+select count(*) from test_jsquery where v @@ 'similar_product_ids.#-1 = "B00005JMAH"'::jsquery;
+select count(*) from test_jsquery where v @@ 'similar_product_ids.#0 = "0440180295"'::jsquery;
+drop index t_idx;
+
+RESET enable_seqscan;